@@ -19,7 +19,9 @@
 #include <dirent.h>
 #include <limits.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <zlib.h>
 
 #include "gene_core.h"
@@ -78,12 +80,13 @@ static char *MyCatenate(char *path, char *sep, char *root, char *suffix)
   len += strlen(root);
   len += strlen(suffix);
   if (len > max)
-    { max = ((int) (1.2*len)) + 100;
-      cat = (char *) realloc(cat,max+1);
-      if (cat == NULL)
+    { char *grow = (char *) realloc(cat,((int) (1.2*len)) + 101);
+      if (grow == NULL)
         { EPRINTF(EPLACE,"%s: Out of memory (Cating 4 strings)\n",Prog_Name);
           return (NULL);
         }
+      cat = grow;
+      max = ((int) (1.2*len)) + 100;
     }
   sprintf(cat,"%s%s%s%s",path,sep,root,suffix);
   return (cat);
@@ -343,102 +346,519 @@ error:
 
 /*******************************************************************************************
  *
- *  GDB CREATION FROM SOURCE
+ *  FASTA INPUT
+ *
+ *  The source is read, and decompressed if gzip'd, by a reader thread into a small queue of
+ *    large blocks that the parser consumes a line at a time, so that decompression overlaps
+ *    parsing and packing.  If the source is BGZF (blocked gzip, e.g. as made by bgzip) then
+ *    each batch of its blocks is inflated by several threads at once, the block sizes being
+ *    known in advance from the BGZF headers.
  *
  ********************************************************************************************/
 
-static char number[128] =
-    { 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 1, 0, 0, 0, 2,
-      0, 0, 0, 0, 0, 0, 4, 0,
-      0, 0, 0, 0, 3, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 1, 0, 0, 0, 2,
-      0, 0, 0, 0, 0, 0, 4, 0,
-      0, 0, 0, 0, 3, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0,
-    };
+#define FA_BLOCK  0x400000   //  Target # of decompressed bytes in a queue block (4MB)
+#define FA_SLOTS  4          //  # of blocks in the queue
+
+typedef struct
+  { char  *data;
+    int64  len;
+    int64  max;
+  } FaBlock;
+
+typedef struct
+  { FILE           *file;       //  source if not gzip'd, or if BGZF
+    gzFile          gzin;       //  source if gzip'd but not BGZF
+    int             bgzf;       //  source is BGZF
+    int             nthreads;   //  # of threads to inflate BGZF batches with
+    char           *spath;
+
+    pthread_t       thread;     //  reader thread and the queue it fills
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    FaBlock         slot[FA_SLOTS];
+    int             head;       //  slot being consumed
+    int             count;      //  # of filled slots (including head)
+    int             eof;        //  reader has queued its last block
+    int             stop;       //  consumer wants the reader to quit
+    int             error;      //  reader failed with message emesg
+    char            emesg[1000];
+
+    FaBlock        *cur;        //  block being consumed (NULL if none) and position in it
+    int64           pos;
+    char           *line;       //  buffer for lines that straddle blocks
+    int             lmax;
+
+    uint8          *raw;        //  compressed BGZF batch
+    int64           rmax;
+  } FaReader;
+
+typedef struct
+  { uint8  *raw;      //  BGZF block is raw[0..clen) and inflates to out[0..isize)
+    int     clen;
+    char   *out;
+    int     isize;
+    uint32  crc;
+  } BgzfBlock;
+
+typedef struct
+  { BgzfBlock *blocks;
+    int        beg, end;
+    int        error;
+  } BgzfParm;
+
+static void *inflate_blocks(void *arg)
+{ BgzfParm  *parm = (BgzfParm *) arg;
+  BgzfBlock *b;
+  z_stream   z;
+  int        i;
+
+  z.zalloc = Z_NULL;
+  z.zfree  = Z_NULL;
+  z.opaque = Z_NULL;
+  z.next_in  = Z_NULL;
+  z.avail_in = 0;
+  if (inflateInit2(&z,-15) != Z_OK)
+    { parm->error = 1;
+      return (NULL);
+    }
+  for (i = parm->beg; i < parm->end; i++)
+    { b = parm->blocks + i;
+      inflateReset(&z);
+      z.next_in   = b->raw;
+      z.avail_in  = b->clen;
+      z.next_out  = (Bytef *) b->out;
+      z.avail_out = b->isize;
+      if (b->isize == 0)
+        continue;
+      if (inflate(&z,Z_FINISH) != Z_STREAM_END || z.avail_out != 0
+                                               || crc32(0,(Bytef *) b->out,b->isize) != b->crc)
+        { parm->error = 1;
+          break;
+        }
+    }
+  inflateEnd(&z);
+  return (NULL);
+}
 
-//  Read next line into a buffer and return a pointer to the buffer and set *plen
-//    the length of the line.  NB: replaces '\n' with '\0'.
+static uint32 get_le(uint8 *p, int n)
+{ uint32 x;
 
-static char *read_line(void *input, int gzipd, int *plen, int nline, char *spath)
-{ static char *buffer;
-  static int   bmax = 0;
-  int len;
+  for (x = 0; n-- > 0; )
+    x = (x << 8) | p[n];
+  return (x);
+}
 
-  if (bmax == 0)
-    { bmax = 500;
-      buffer = (char *) malloc(bmax);
-      if (buffer == NULL)
-        { EPRINTF(EPLACE,"%s: Out of memory reading %s\n",Prog_Name,spath);
-          return (ERROR);
+  //  Return the total size of the BGZF block whose 18 byte header is at h, or 0 if it
+  //    is not a BGZF header.
+
+static int bgzf_size(uint8 *h)
+{ if (h[0] != 31 || h[1] != 139 || h[2] != 8 || (h[3] & 0x4) == 0)
+    return (0);
+  if (get_le(h+10,2) != 6 || h[12] != 'B' || h[13] != 'C' || get_le(h+14,2) != 2)
+    return (0);
+  return (get_le(h+16,2) + 1);
+}
+
+  //  Fill b with the next batch of BGZF blocks, inflated in parallel
+
+static int fill_bgzf(FaReader *r, FaBlock *b)
+{ BgzfBlock *blocks;
+  BgzfParm  *parm;
+  pthread_t *threads;
+  int        nblk, bmax, bsize, t, nt;
+  int64      rlen, olen;
+  uint8     *h;
+
+  bmax  = 2*(FA_BLOCK/0x10000) + 16;
+  blocks  = (BgzfBlock *) malloc(sizeof(BgzfBlock)*bmax);
+  parm    = (BgzfParm *) malloc(sizeof(BgzfParm)*r->nthreads);
+  threads = (pthread_t *) malloc(sizeof(pthread_t)*r->nthreads);
+  if (blocks == NULL || parm == NULL || threads == NULL)
+    { sprintf(r->emesg,"%s: Out of memory reading %s\n",Prog_Name,r->spath);
+      goto fail;
+    }
+
+  //  Read whole blocks until the batch will inflate to at least FA_BLOCK bytes
+
+  rlen = 0;
+  olen = 0;
+  nblk = 0;
+  while (nblk < bmax && olen < FA_BLOCK)
+    { if (rlen + 0x10000 > r->rmax)
+        { uint8 *grow = (uint8 *) realloc(r->raw,rlen + 0x10000 + FA_BLOCK);
+          if (grow == NULL)
+            { sprintf(r->emesg,"%s: Out of memory reading %s\n",Prog_Name,r->spath);
+              goto fail;
+            }
+          r->raw  = grow;
+          r->rmax = rlen + 0x10000 + FA_BLOCK;
         }
+      h = r->raw + rlen;
+      t = fread(h,1,18,r->file);
+      if (t == 0 && feof(r->file))
+        break;
+      if (t != 18 || (bsize = bgzf_size(h)) < 26)
+        { sprintf(r->emesg,"%s: Corrupted BGZF block in %s\n",Prog_Name,r->spath);
+          goto fail;
+        }
+      if (fread(h+18,bsize-18,1,r->file) != 1)
+        { sprintf(r->emesg,"%s: Truncated BGZF block in %s\n",Prog_Name,r->spath);
+          goto fail;
+        }
+      blocks[nblk].clen  = bsize-26;
+      blocks[nblk].crc   = get_le(h+(bsize-8),4);
+      blocks[nblk].isize = get_le(h+(bsize-4),4);
+      if (blocks[nblk].isize == 0)    //  e.g. an end-of-file marker, possibly mid-file
+        continue;
+      olen += blocks[nblk].isize;
+      rlen += bsize;
+      nblk += 1;
     }
 
-  if (gzipd)
-    { if (gzgets(input,buffer,bmax) == NULL)
-        { if (gzeof(input))
-            return (NULL);
-          EPRINTF(EPLACE,"%s: Could not read next line, %d, of file %s\n",Prog_Name,nline,spath);
-          return (ERROR);
+  if (olen > b->max)
+    { char *grow = (char *) realloc(b->data,olen + 0x10000);
+      if (grow == NULL)
+        { sprintf(r->emesg,"%s: Out of memory reading %s\n",Prog_Name,r->spath);
+          goto fail;
+        }
+      b->data = grow;
+      b->max  = olen + 0x10000;
+    }
+
+  rlen = 0;
+  olen = 0;
+  for (t = 0; t < nblk; t++)
+    { blocks[t].raw = r->raw + rlen + 18;
+      blocks[t].out = b->data + olen;
+      rlen += blocks[t].clen + 26;
+      olen += blocks[t].isize;
+    }
+  b->len = olen;
+
+  nt = r->nthreads;
+  if (nt > nblk)
+    nt = nblk;
+  for (t = 0; t < nt; t++)
+    { parm[t].blocks = blocks;
+      parm[t].beg    = (nblk*((int64) t))/nt;
+      parm[t].end    = (nblk*((int64) (t+1)))/nt;
+      parm[t].error  = 0;
+    }
+  for (t = 1; t < nt; t++)
+    pthread_create(threads+t,NULL,inflate_blocks,parm+t);
+  if (nt > 0)
+    inflate_blocks(parm);
+  for (t = 1; t < nt; t++)
+    pthread_join(threads[t],NULL);
+  for (t = 0; t < nt; t++)
+    if (parm[t].error)
+      { sprintf(r->emesg,"%s: Could not inflate BGZF block of %s\n",Prog_Name,r->spath);
+        goto fail;
+      }
+
+  free(threads);
+  free(parm);
+  free(blocks);
+  return (0);
+
+fail:
+  free(threads);
+  free(parm);
+  free(blocks);
+  return (1);
+}
+
+static int fill_block(FaReader *r, FaBlock *b)
+{ int n;
+
+  if (r->bgzf)
+    return (fill_bgzf(r,b));
+
+  if (b->max < FA_BLOCK)
+    { char *grow = (char *) realloc(b->data,FA_BLOCK);
+      if (grow == NULL)
+        { sprintf(r->emesg,"%s: Out of memory reading %s\n",Prog_Name,r->spath);
+          return (1);
+        }
+      b->data = grow;
+      b->max  = FA_BLOCK;
+    }
+  if (r->gzin != NULL)
+    { n = gzread(r->gzin,b->data,FA_BLOCK);
+      if (n < 0)
+        { sprintf(r->emesg,"%s: Could not decompress %s\n",Prog_Name,r->spath);
+          return (1);
         }
     }
   else
-    { if (fgets(buffer,bmax,input) == NULL)
-        { if (feof(input))
-            return (NULL);
-          EPRINTF(EPLACE,"%s: Could not read next line, %d, of file %s\n",Prog_Name,nline,spath);
-          return (ERROR);
+    { n = fread(b->data,1,FA_BLOCK,r->file);
+      if (n < FA_BLOCK && ferror(r->file))
+        { sprintf(r->emesg,"%s: Could not read %s\n",Prog_Name,r->spath);
+          return (1);
         }
     }
+  b->len = n;
+  return (0);
+}
 
-  len = strlen(buffer);
-  while (buffer[len-1] != '\n')
-    { bmax = ((int) (1.4*bmax)) + 100;
-      buffer = (char *) realloc(buffer,bmax);
-      if (buffer == NULL)
-        { EPRINTF(EPLACE,"%s: Out of memory reading %s\n",Prog_Name,spath);
-          return (ERROR);
+static void *fasta_reader(void *arg)
+{ FaReader *r = (FaReader *) arg;
+  FaBlock  *b;
+  int       err;
+
+  while (1)
+    { pthread_mutex_lock(&(r->mutex));
+      while (r->count == FA_SLOTS && ! r->stop)
+        pthread_cond_wait(&(r->cond),&(r->mutex));
+      if (r->stop)
+        { pthread_mutex_unlock(&(r->mutex));
+          break;
         }
-      if (gzipd)
-        { if (gzgets(input,buffer+len,bmax-len) == NULL)
-            { if (gzeof(input))
-                EPRINTF(EPLACE,"%s: Last line %d of file %s does not end with new-line\n",
-                               Prog_Name,nline,spath);
-              else
-                EPRINTF(EPLACE,"%s: Could not read next line, %d, of file %s\n",
-                               Prog_Name,nline,spath);
-              return (ERROR);
-            }
+      b = r->slot + (r->head + r->count) % FA_SLOTS;
+      pthread_mutex_unlock(&(r->mutex));
+
+      err = fill_block(r,b);
+
+      pthread_mutex_lock(&(r->mutex));
+      if (err)
+        r->error = 1;
+      else if (b->len == 0)
+        r->eof = 1;
+      else
+        r->count += 1;
+      pthread_cond_signal(&(r->cond));
+      pthread_mutex_unlock(&(r->mutex));
+      if (err || b->len == 0)
+        break;
+    }
+  return (NULL);
+}
+
+static void close_fasta(FaReader *r)
+{ int i;
+
+  pthread_mutex_lock(&(r->mutex));
+  r->stop = 1;
+  pthread_cond_signal(&(r->cond));
+  pthread_mutex_unlock(&(r->mutex));
+  pthread_join(r->thread,NULL);
+
+  pthread_cond_destroy(&(r->cond));
+  pthread_mutex_destroy(&(r->mutex));
+  for (i = 0; i < FA_SLOTS; i++)
+    free(r->slot[i].data);
+  free(r->line);
+  free(r->raw);
+  if (r->gzin != NULL)
+    gzclose(r->gzin);
+  if (r->file != NULL)
+    fclose(r->file);
+  free(r);
+}
+
+static FaReader *open_fasta(char *spath, int gzipd)
+{ FaReader *r;
+  uint8     head[18];
+  int       i;
+
+  r = (FaReader *) malloc(sizeof(FaReader));
+  if (r == NULL)
+    { EPRINTF(EPLACE,"%s: Out of memory reading %s\n",Prog_Name,spath);
+      return (NULL);
+    }
+  r->spath = spath;
+  r->file  = NULL;
+  r->gzin  = NULL;
+  r->bgzf  = 0;
+
+  r->file = fopen(spath,"r");
+  if (r->file == NULL)
+    { EPRINTF(EPLACE,"%s: Cannot open %s for reading\n",Prog_Name,spath);
+      free(r);
+      return (NULL);
+    }
+  if (gzipd)
+    { if (fread(head,18,1,r->file) == 1 && bgzf_size(head) > 0)
+        { r->bgzf = 1;
+          rewind(r->file);
         }
       else
-        { if (fgets(buffer+len,bmax-len,input) == NULL)
-            { if (feof(input))
-                EPRINTF(EPLACE,"%s: Last line %d of file %s does not end with new-line\n",
-                               Prog_Name,nline,spath);
-              else
-                EPRINTF(EPLACE,"%s: Could not read next line, %d, of file %s\n",
-                               Prog_Name,nline,spath);
-              return (ERROR);
+        { fclose(r->file);
+          r->file = NULL;
+          r->gzin = gzopen(spath,"r");
+          if (r->gzin == NULL)
+            { EPRINTF(EPLACE,"%s: Cannot open %s for reading\n",Prog_Name,spath);
+              free(r);
+              return (NULL);
             }
+          gzbuffer(r->gzin,0x40000);
         }
-      len += strlen(buffer+len);
     }
-  buffer[--len] = '\0';
+
+  r->nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (r->nthreads < 1)
+    r->nthreads = 1;
+  else if (r->nthreads > 64)
+    r->nthreads = 64;
+
+  for (i = 0; i < FA_SLOTS; i++)
+    { r->slot[i].data = NULL;
+      r->slot[i].len  = 0;
+      r->slot[i].max  = 0;
+    }
+  r->head  = 0;
+  r->count = 0;
+  r->eof   = 0;
+  r->stop  = 0;
+  r->error = 0;
+  r->cur   = NULL;
+  r->pos   = 0;
+  r->line  = NULL;
+  r->lmax  = 0;
+  r->raw   = NULL;
+  r->rmax  = 0;
+
+  pthread_mutex_init(&(r->mutex),NULL);
+  pthread_cond_init(&(r->cond),NULL);
+  pthread_create(&(r->thread),NULL,fasta_reader,r);
+
+  return (r);
+}
+
+  //  Release the current block and wait for the next one.  Return 0 if there is one,
+  //    1 at the end of the source, and -1 (with a message at EPLACE) on error.
+
+static int next_block(FaReader *r)
+{ int status;
+
+  pthread_mutex_lock(&(r->mutex));
+  if (r->cur != NULL)
+    { r->head   = (r->head+1) % FA_SLOTS;
+      r->count -= 1;
+      r->cur    = NULL;
+      pthread_cond_signal(&(r->cond));
+    }
+  while (r->count == 0 && ! r->eof && ! r->error)
+    pthread_cond_wait(&(r->cond),&(r->mutex));
+  if (r->count > 0)
+    { r->cur = r->slot + r->head;
+      r->pos = 0;
+      status = 0;
+    }
+  else if (r->error)
+    { EPRINTF(EPLACE,"%s",r->emesg);
+      status = -1;
+    }
+  else
+    status = 1;
+  pthread_mutex_unlock(&(r->mutex));
+  return (status);
+}
+
+  //  Append s[0..n) to the straddling line buffer that already holds len bytes
+
+static int grow_line(FaReader *r, int len, char *s, int64 n)
+{ if (len + n + 1 > r->lmax)
+    { int   lmax = ((int) (1.4*(len+n+1))) + 100;
+      char *grow = (char *) realloc(r->line,lmax);
+      if (grow == NULL)
+        { EPRINTF(EPLACE,"%s: Out of memory reading %s\n",Prog_Name,r->spath);
+          return (1);
+        }
+      r->line = grow;
+      r->lmax = lmax;
+    }
+  memcpy(r->line+len,s,n);
+  return (0);
+}
+
+//  Read next line and return a pointer to it and set *plen to the length of the line.
+//    NB: replaces '\n' with '\0'.  The line is only valid until the next call.
+
+static char *read_line(FaReader *r, int *plen, int nline, char *spath)
+{ char *s, *e;
+  int64 n;
+  int   len, status;
+
+  if (r->cur == NULL || r->pos >= r->cur->len)
+    { status = next_block(r);
+      if (status < 0)
+        return (ERROR);
+      if (status > 0)
+        return (NULL);
+    }
+
+  s = r->cur->data + r->pos;
+  n = r->cur->len - r->pos;
+  e = memchr(s,'\n',n);
+  if (e != NULL)
+    { *e = '\0';
+      len = e-s;
+      r->pos += len+1;
+      if (plen != NULL)
+        *plen = len;
+      return (s);
+    }
+
+  //  The line straddles blocks: assemble it in r->line
+
+  len = 0;
+  while (1)
+    { if (grow_line(r,len,s,n))
+        return (ERROR);
+      len += n;
+      status = next_block(r);
+      if (status < 0)
+        return (ERROR);
+      if (status > 0)
+        { EPRINTF(EPLACE,"%s: Last line %d of file %s does not end with new-line\n",
+                         Prog_Name,nline,spath);
+          return (ERROR);
+        }
+      s = r->cur->data;
+      n = r->cur->len;
+      e = memchr(s,'\n',n);
+      if (e != NULL)
+        { if (grow_line(r,len,s,e-s))
+            return (ERROR);
+          len += e-s;
+          r->pos = (e-s)+1;
+          break;
+        }
+    }
+  r->line[len] = '\0';
 
   if (plen != NULL)
     *plen = len;
-  return (buffer);
+  return (r->line);
 }
 
+
+/*******************************************************************************************
+ *
+ *  GDB CREATION FROM SOURCE
+ *
+ ********************************************************************************************/
+
+static char number[128] =
+    { 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 1, 0, 0, 0, 2,
+      0, 0, 0, 0, 0, 0, 4, 0,
+      0, 0, 0, 0, 3, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+      0, 0, 0, 1, 0, 0, 0, 2,
+      0, 0, 0, 0, 0, 0, 4, 0,
+      0, 0, 0, 0, 3, 0, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0,
+    };
+
 FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nthresh)
 { GDB_SCAFFOLD  *scaffs;
   GDB_CONTIG    *contigs;
@@ -454,10 +874,11 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
   int            len, clen;
   int64          spos;
 
-  int            gzipd, nline, has_mask;
-  void          *input;
+  int            nline, has_mask;
+  FaReader      *input;
   OneSchema     *schema;
   OneFile       *of;
+  void          *grow;
 
   prov  = NULL;
   input  = NULL;
@@ -627,11 +1048,12 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
               }
             if (nscaff >= scftop)
               { scftop = 1.2*nscaff + 500;
-                scaffs = realloc(scaffs,scftop*sizeof(GDB_SCAFFOLD));
-                if (scaffs == NULL)
+                grow = realloc(scaffs,scftop*sizeof(GDB_SCAFFOLD));
+                if (grow == NULL)
                   { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                     goto error;
                   }
+                scaffs = (GDB_SCAFFOLD *) grow;
               }
             scaffs[nscaff].hoff = hdrtot;
             scaffs[nscaff].fctg = ncontig;
@@ -640,11 +1062,12 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
             len = oneLen(of);
             if (hdrtot + len + 1 > hdrtop)
               { hdrtop = 1.2*(hdrtot+len+1) + 10000;
-                headers = realloc(headers,hdrtop);
-                if (headers == NULL)
+                grow = realloc(headers,hdrtop);
+                if (grow == NULL)
                   { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                     goto error;
                   }
+                headers = (char *) grow;
               }
             memcpy(headers+hdrtot,oneString(of),len);
             hdrtot += len;
@@ -664,11 +1087,12 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
     
             if (ncontig >= ctgtop)
               { ctgtop = 1.2*ncontig + 1000;
-                contigs = realloc(contigs,(ctgtop+1)*sizeof(GDB_CONTIG));
-                if (contigs == NULL)
+                grow = realloc(contigs,(ctgtop+1)*sizeof(GDB_CONTIG));
+                if (grow == NULL)
                   { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                     goto error;
                   }
+                contigs = (GDB_CONTIG *) grow;
               }
             contigs[ncontig].boff = boff;
             contigs[ncontig].moff = nmasks;
@@ -703,11 +1127,12 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
 
             if (nmasks + len/2 >= msktop)
               { msktop = 1.2*(nmasks+len/2) + 1000;
-                masks  = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
-                if (masks == NULL)
+                grow = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
+                if (grow == NULL)
                   { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                     goto error;
                   }
+                masks = (GDB_MASK *) grow;
               }
             has_mask = 1;
 
@@ -733,11 +1158,12 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
             len = oneLen(of);
             if (hdrtot + len + 1 > hdrtop)
               { hdrtop = 1.2*(hdrtot+len+1) + 10000;
-                headers = realloc(headers,hdrtop);
-                if (headers == NULL)
+                grow = realloc(headers,hdrtop);
+                if (grow == NULL)
                   { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                     goto error;
                   }
+                headers = (char *) grow;
               }
             memcpy(headers+hdrtot,oneString(of),len);
             hdrtot += len;
@@ -775,15 +1201,9 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
       byte    = 0;
       bpscur  = 0;
 
-      gzipd = (ftype == IS_FA_GZ);
-      if (gzipd)
-        input = gzopen(spath,"r");
-      else
-        input = fopen(spath,"r");
+      input = open_fasta(spath,ftype == IS_FA_GZ);
       if (input == NULL)
-        { EPRINTF(EPLACE,"%s: Cannot open %s for reading\n",Prog_Name,spath);
-          goto error;
-        }
+        goto error;
 
       nprov = 0;
       prov  = NULL;
@@ -791,7 +1211,7 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
       //  Get the header of the first line.  If the file is empty skip.
     
       nline = 1;
-      line  = read_line(input,gzipd,&len,nline,spath);
+      line  = read_line(input,&len,nline,spath);
       if (line == ERROR)
         goto error;
       else if (line == NULL)
@@ -813,22 +1233,24 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
     
           if (nscaff >= scftop)
             { scftop = 1.2*nscaff + 500;
-              scaffs = realloc(scaffs,scftop*sizeof(GDB_SCAFFOLD));
-              if (scaffs == NULL)
+              grow = realloc(scaffs,scftop*sizeof(GDB_SCAFFOLD));
+              if (grow == NULL)
                 { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                   goto error;
                 }
+              scaffs = (GDB_SCAFFOLD *) grow;
             }
           scaffs[nscaff].fctg = ncontig;
           scaffs[nscaff].hoff = hdrtot; 
     
           if (hdrtot + len + 1 > hdrtop)
             { hdrtop = 1.2*(hdrtot+len+1) + 10000;
-              headers = realloc(headers,hdrtop);
-              if (headers == NULL)
+              grow = realloc(headers,hdrtop);
+              if (grow == NULL)
                 { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",Prog_Name,spath);
                   goto error;
                 }
+              headers = (char *) grow;
             }
           memcpy(headers+hdrtot,line+s,len);
           hdrtot += len;
@@ -843,7 +1265,7 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
           lastn = 0;
           while (1)
             { nline += 1;
-              line = read_line(input,gzipd,&len,nline,spath);
+              line = read_line(input,&len,nline,spath);
               if (line == ERROR)
                 goto error;
               else if (line == NULL || line[0] == '>')
@@ -904,12 +1326,13 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
                           if (mask >= 0)
                             { if (nmasks >= msktop)
                                 { msktop = 1.2*nmasks + 1000;
-                                  masks  = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
-                                  if (masks == NULL)
+                                  grow = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
+                                  if (grow == NULL)
                                     { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",
                                                      Prog_Name,spath);
                                       goto error;
                                     }
+                                  masks = (GDB_MASK *) grow;
                                 }
                               masks[nmasks].beg = mask;
                               masks[nmasks].end = clen; 
@@ -921,12 +1344,13 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
   
                           if (ncontig >= ctgtop)
                             { ctgtop = 1.2*ncontig + 1000;
-                              contigs = realloc(contigs,(ctgtop+1)*sizeof(GDB_CONTIG));
-                              if (contigs == NULL)
+                              grow = realloc(contigs,(ctgtop+1)*sizeof(GDB_CONTIG));
+                              if (grow == NULL)
                                 { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",
                                                  Prog_Name,spath);
                                   goto error;
                                 }
+                              contigs = (GDB_CONTIG *) grow;
                             }
                           contigs[ncontig].clen = clen;
                           contigs[ncontig].sbeg = spos;
@@ -982,12 +1406,13 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
                         { if (mask >= 0)
                             { if (nmasks >= msktop)
                                 { msktop = 1.2*nmasks + 1000;
-                                  masks  = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
-                                  if (masks == NULL)
+                                  grow = realloc(masks,(msktop+1)*sizeof(GDB_MASK));
+                                  if (grow == NULL)
                                     { EPRINTF(EPLACE,"%s: Out of memory creating GDB for %s\n",
                                                      Prog_Name,spath);
                                       goto error;
                                     }
+                                  masks = (GDB_MASK *) grow;
                                 }
                               masks[nmasks].beg = mask;
                               masks[nmasks].end = clen + (s-boc); 
@@ -1029,10 +1454,7 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
       if (bpscur > 0)
         fwrite(bpsbuf,bpscur,1,bases);
 
-      if (gzipd)
-        gzclose(input);
-      else
-        fclose(input);
+      close_fasta(input);
     }
 
   if (bps > 0)
@@ -1054,7 +1476,20 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
       masks = NULL;
     }
   else
-    masks = realloc(masks,(nmasks+1)*sizeof(GDB_MASK));
+    { grow = realloc(masks,(nmasks+1)*sizeof(GDB_MASK));
+      if (grow != NULL)                //  a failed shrink leaves the larger block in place
+        masks = (GDB_MASK *) grow;
+    }
+
+  grow = realloc(scaffs,(nscaff+1)*sizeof(GDB_SCAFFOLD));
+  if (grow != NULL)
+    scaffs = (GDB_SCAFFOLD *) grow;
+  grow = realloc(contigs,(ncontig+1)*sizeof(GDB_CONTIG));
+  if (grow != NULL)
+    contigs = (GDB_CONTIG *) grow;
+  grow = realloc(headers,hdrtot+1);
+  if (grow != NULL)
+    headers = (char *) grow;
 
   gdb->nprov = nprov;
   gdb->prov  = prov;
@@ -1066,14 +1501,15 @@ FILE **Create_GDB(GDB *gdb, char *spath, int ftype, int bps, char *tpath, int nt
   gdb->hdrtot  = hdrtot;
   gdb->seqtot  = seqtot;
 
-  gdb->scaffolds = realloc(scaffs,nscaff*sizeof(GDB_SCAFFOLD));
-  gdb->contigs   = realloc(contigs,(ncontig+1)*sizeof(GDB_CONTIG));
+  gdb->scaffolds = scaffs;
+  gdb->contigs   = contigs;
   gdb->masks     = masks;
-  gdb->headers   = realloc(headers,hdrtot);
+  gdb->headers   = headers;
   gdb->seqstate  = EXTERNAL;
   gdb->seqsrc    = ftype;
   gdb->seqpath   = seqpath;
   gdb->seqs      = bases;
+  gdb->seqmap    = 0;
 
   gdb->freq[0] = (1.*count[0])/seqtot;
   gdb->freq[1] = (1.*count[1])/seqtot;
@@ -1106,11 +1542,7 @@ error:
   if (schema != NULL)
     oneSchemaDestroy(schema);
   if (input != NULL)
-    { if (gzipd)
-        gzclose(input);
-      else
-        fclose(input);
-    }
+    close_fasta(input);
   free(prov);
   free(gdb->srcpath);
   free(headers);
@@ -1365,6 +1797,7 @@ int Read_GDB(GDB *gdb, char *path)
   gdb->seqtot   = seqtot;
   gdb->seqstate = EXTERNAL;
   gdb->seqs     = seqs;
+  gdb->seqmap   = 0;
 
   srcpath += strlen(srcpath);
   if (strcmp(srcpath-3,".gz") == 0)
@@ -1511,6 +1944,47 @@ int Load_Sequences(GDB *gdb, int stype)
   return (0);
 }
 
+// The .bps file of an EXTERNAL gdb is memory mapped and its file pointer closed.  As the
+//   mapping is exactly the image Load_Sequences(gdb,COMPRESSED) would read in, the boff
+//   fields are unchanged and all the COMPRESSED access routines apply.
+// If in interactive mode, 1 is returned on error.
+
+int Map_Sequences(GDB *gdb)
+{ FILE       *b = (FILE *) gdb->seqs;
+  struct stat state;
+  void       *map;
+
+  if (b == NULL)
+    { EPRINTF(EPLACE,"%s: GDB has no sequence data (Map_Sequences)\n",Prog_Name);
+      EXIT(1);
+    }
+  if (gdb->seqstate != EXTERNAL)
+    { EPRINTF(EPLACE,"%s: GDB's sequencing info already loaded (Map_Sequences)\n",Prog_Name);
+      EXIT(1);
+    }
+
+  if (fstat(fileno(b),&state) < 0)
+    { EPRINTF(EPLACE,"%s: Cannot fetch size of GDB's base pair file (Map_Sequences)\n",
+                     Prog_Name);
+      EXIT(1);
+    }
+  if (state.st_size == 0)
+    { EPRINTF(EPLACE,"%s: GDB's base pair file is empty (Map_Sequences)\n",Prog_Name);
+      EXIT(1);
+    }
+  map = mmap(NULL,state.st_size,PROT_READ,MAP_SHARED,fileno(b),0);
+  if (map == MAP_FAILED)
+    { EPRINTF(EPLACE,"%s: Cannot memory map GDB's base pair file (Map_Sequences)\n",Prog_Name);
+      EXIT(1);
+    }
+
+  fclose(b);
+  gdb->seqstate = COMPRESSED;
+  gdb->seqs     = map;
+  gdb->seqmap   = state.st_size;
+  return (0);
+}
+
 // Write the given gdb to the file 'tpath'.  The GDB must have seqstate EXTERNAL and tpath
 //   must be consistent with the name of the .bps file.
 
@@ -1572,7 +2046,7 @@ int Write_GDB(GDB *gdb, char *tpath)
     }
 
   addProvenance(of,gdb->prov,gdb->nprov);
-  oneAddProvenance(of,Prog_Name,"0.1",Command_Line);
+  oneAddProvenance(of,Prog_Name,"0.1","%s",Command_Line != NULL ? Command_Line : "");
 
   oneAddReference(of,gdb->srcpath,1);
 
@@ -1623,6 +2097,8 @@ void Close_GDB(GDB *gdb)
 { if (gdb->seqs != NULL)
     { if (gdb->seqstate == EXTERNAL)
         fclose(gdb->seqs);
+      else if (gdb->seqmap > 0)
+        munmap(gdb->seqs,gdb->seqmap);
       else if (gdb->seqstate == COMPRESSED)
         free(gdb->seqs);
       else
@@ -1644,10 +2120,154 @@ void Close_GDB(GDB *gdb)
  *
  ********************************************************************************************/
 
+static char *GDB_Cache = NULL;   //  Directory of GDB's made from FASTA/1-seq sources, if set
+
+void Set_GDB_Cache(char *dir)
+{ free(GDB_Cache);
+  if (dir == NULL || *dir == '\0')
+    GDB_Cache = NULL;
+  else
+    GDB_Cache = strdup(dir);
+}
+
+char *Get_GDB_Cache()
+{ return (GDB_Cache); }
+
+#define KEY_SAMPLE 0x10000   //  # of bytes hashed at each of 3 places in a source file
+
+//  Hash the absolute source path, size, and modification time of spath, and 64KB of its
+//    content at its start, middle, and end, into a key for the cache.  Returns 0 if the
+//    file cannot be stat'ed or read.
+
+static uint64 source_key(char *spath)
+{ struct stat state;
+  uint64      h;
+  int64       off[3];
+  uint8      *buf;
+  FILE       *f;
+  int         i, n, k;
+
+  if (stat(spath,&state) < 0)
+    return (0);
+  buf = malloc(KEY_SAMPLE);
+  f   = fopen(spath,"r");
+  if (buf == NULL || f == NULL)
+    { free(buf);
+      if (f != NULL)
+        fclose(f);
+      return (0);
+    }
+
+  h = 0xcbf29ce484222325llu;
+#define HASH_BYTE(c) { h ^= (uint8) (c); h *= 0x100000001b3llu; }
+
+  for (i = 0; spath[i] != '\0'; i++)
+    HASH_BYTE(spath[i])
+  for (i = 0; i < 8; i++)
+    HASH_BYTE(((int64) state.st_size) >> (8*i))
+  for (i = 0; i < 8; i++)
+    HASH_BYTE(((int64) state.st_mtime) >> (8*i))
+
+  off[0] = 0;
+  off[1] = state.st_size/2;
+  off[2] = state.st_size - KEY_SAMPLE;
+  for (k = 0; k < 3; k++)
+    { if (off[k] < 0)
+        off[k] = 0;
+      fseeko(f,off[k],SEEK_SET);
+      n = fread(buf,1,KEY_SAMPLE,f);
+      if (n < KEY_SAMPLE && ferror(f))
+        { fclose(f);
+          free(buf);
+          return (0);
+        }
+      for (i = 0; i < n; i++)
+        HASH_BYTE(buf[i])
+    }
+#undef HASH_BYTE
+
+  fclose(f);
+  free(buf);
+  if (h == 0)
+    h = 1;
+  return (h);
+}
+
+//  Return the path of the cached GDB for spath, making it if it is not already in the
+//    cache, or NULL if this cannot be done.  A new entry is made under a name unique to
+//    this process and then renamed, .bps file first, so a .1gdb in the cache is always
+//    complete and two processes making the same entry cannot interfere.
+
+static char *cached_gdb(char *spath, int type)
+{ GDB    _tmp, *tmp = &_tmp;
+  uint64  key;
+  char   *root, *name, *tname, *bps, *tbps;
+  char    suffix[50];
+  FILE   *test;
+
+  key = source_key(spath);
+  if (key == 0)
+    return (NULL);
+
+  root = Root(spath,"");
+  if (root == NULL)
+    return (NULL);
+
+  sprintf(suffix,".%016llx.1gdb",key);
+  name = Strdup(MyCatenate(GDB_Cache,"/",root,suffix),"Allocating cache path");
+  if (name == NULL)
+    { free(root);
+      return (NULL);
+    }
+
+  test = fopen(name,"r");
+  if (test != NULL)
+    { fclose(test);
+      free(root);
+      return (name);
+    }
+
+  sprintf(suffix,".%016llx.%d.tmp.1gdb",key,getpid());
+  tname = Strdup(MyCatenate(GDB_Cache,"/",root,suffix),"Allocating cache path");
+  sprintf(suffix,".%016llx.%d.tmp.bps",key,getpid());
+  tbps  = Strdup(MyCatenate(GDB_Cache,"/.",root,suffix),"Allocating cache path");
+  sprintf(suffix,".%016llx.bps",key);
+  bps   = Strdup(MyCatenate(GDB_Cache,"/.",root,suffix),"Allocating cache path");
+  free(root);
+  if (tname == NULL || tbps == NULL || bps == NULL)
+    goto error;
+
+  if (Create_GDB(tmp,spath,type,1,tname,0) == NULL)
+    goto error;
+  if (Write_GDB(tmp,tname))
+    { Close_GDB(tmp);
+      goto error;
+    }
+  Close_GDB(tmp);
+  if (rename(tbps,bps) < 0 || rename(tname,name) < 0)
+    goto error;
+
+  free(bps);
+  free(tbps);
+  free(tname);
+  return (name);
+
+error:
+  if (tname != NULL)
+    unlink(tname);
+  if (tbps != NULL)
+    unlink(tbps);
+  free(bps);
+  free(tbps);
+  free(tname);
+  free(name);
+  return (NULL);
+}
+
 FILE **Get_GDB(GDB *gdb, char *source, char *cpath, int num_bps)
 { int   used_cpath;
   int   i, type;
-  char *spath, *tpath;
+  char *spath, *tpath, *cache;
   FILE *test, **units;
 
   used_cpath = 0;
@@ -1667,25 +2287,49 @@ FILE **Get_GDB(GDB *gdb, char *source, char *cpath, int num_bps)
   type = Get_GDB_Paths(source,NULL,&spath,&tpath,0);
   if (type < 0)
     goto error;
-  else if (type != IS_GDB)
+
+  //  With a cache, a FASTA or 1-seq source is read (after it is converted the first time)
+  //    from its GDB in the cache, falling back to a direct conversion if that fails
+
+  cache = NULL;
+  if (type != IS_GDB && GDB_Cache != NULL && num_bps > 0)
+    { cache = cached_gdb(spath,type);
+      if (cache != NULL)
+        { if (Read_GDB(gdb,cache) == 0)
+            { if (gdb->seqs != NULL)
+                { type  = IS_GDB;
+                  tpath = cache;
+                }
+              else
+                Close_GDB(gdb);
+            }
+          if (type != IS_GDB)
+            { unlink(cache);
+              free(cache);
+              cache = NULL;
+            }
+        }
+    }
+
+  if (type != IS_GDB)
     { units = Create_GDB(gdb,spath,type,num_bps,NULL,0);
       if (units == NULL)
         goto error;
     }
   else
-    { if (Read_GDB(gdb,tpath))
+    { if (cache == NULL && Read_GDB(gdb,tpath))
         goto error;
       units = (FILE **) &(gdb->seqs);
       if (num_bps > 0)
         { if (gdb->seqs == NULL)
             { EPRINTF(EPLACE,"%s: GDB %s must have sequence data\n",Prog_Name,tpath);
-              goto error;
+              goto close;
             }
           if (num_bps > 1)
             { units = malloc(sizeof(FILE *)*num_bps);
               if (units == NULL)
                 { EPRINTF(EPLACE,"%s: Could not allocate units array for GDB's\n",Prog_Name);
-                  goto error;
+                  goto close;
                 }
               units[0] = gdb->seqs;
               for (i = 1; i < num_bps; i++)
@@ -1693,8 +2337,10 @@ FILE **Get_GDB(GDB *gdb, char *source, char *cpath, int num_bps)
                   if (units[i] == NULL)
                     { EPRINTF(EPLACE,"%s: Cannot open another copye of GDB bps %s\n",
                                      Prog_Name,gdb->seqpath);
+                      while (--i > 0)
+                        fclose(units[i]);
                       free(units);
-                      goto error;
+                      goto close;
                     }
                 }
             }
@@ -1705,6 +2351,8 @@ FILE **Get_GDB(GDB *gdb, char *source, char *cpath, int num_bps)
     free(source);
   return (units);
 
+close:
+  Close_GDB(gdb);
 error:
   if (used_cpath)
     free(source);
@@ -1870,6 +2518,7 @@ char *Get_Contig_Piece(GDB *gdb, int i, int beg, int end, int stype, char *buffe
   char       *m  = (char *) gdb->seqs;
   GDB_CONTIG *c = gdb->contigs;
   GDB_MASK   *masks = gdb->masks;
+  char       *src;
   int64       off;
   int         len, clen, bbeg;
 
@@ -1904,84 +2553,132 @@ char *Get_Contig_Piece(GDB *gdb, int i, int beg, int end, int stype, char *buffe
   len  = end - beg;
   clen = ((end-1)/4+1) - bbeg;
 
-  if (gdb->seqstate != EXTERNAL)
-    { if (gdb->seqstate == COMPRESSED)
-        { memcpy(buffer,m + off,clen);
-          Uncompress_Read(len,buffer);
-          buffer += beg%4;
-          buffer[len] = 4;
-          if (stype == LOWER_CASE)
-            Lower_Read(buffer);
-          else if (stype == UPPER_CASE)
-            Upper_Read(buffer);
+  //  2-bit sequence, in memory or on disk, is decoded for exactly [beg,end) straight into
+  //    buffer (in-place after the bytes are read into the front of buffer in the latter case)
+
+  if (gdb->seqstate == COMPRESSED)
+    src = m + off;
+  else if (gdb->seqstate == EXTERNAL)
+    { if (ftello(b) != off)
+        fseeko(b,off,SEEK_SET);
+      if (len > 0)
+        { if (fread(buffer,clen,1,b) != 1)
+            { EPRINTF(EPLACE,"%s: Failed read of GDB sequence file (Get_Contig_Piece)\n",
+                             Prog_Name);
+              EXIT(NULL);
+            }
+        }
+      src = buffer;
+    }
+  else
+    src = NULL;
+
+  if (src != NULL)
+    { if (len <= 0)
+        { if (stype == NUMERIC)
+            buffer[0] = 4;
+          else
+            buffer[0] = '\0';
         }
+      else if (stype == NUMERIC)
+        Uncompress_Range(src,beg%4,len,buffer);
       else
-        { memcpy(buffer,m + off + (beg%4),len+1);
-          buffer[len] = '\0';
-          if (stype != gdb->seqstate)
-            { if (stype == NUMERIC)
-                Number_Read(buffer);
-              else if (gdb->seqstate == NUMERIC)
-                { buffer[len] = 4;
-                  if (stype == UPPER_CASE)
-                    Upper_Read(buffer);
-                  else
-                    Lower_Read(buffer);
-                }
+        Letter_Range(src,beg%4,len,buffer,stype == UPPER_CASE);
+    }
+  else
+    { memcpy(buffer,m + c[i].boff + beg,len+1);
+      buffer[len] = '\0';
+      if (stype != gdb->seqstate)
+        { if (stype == NUMERIC)
+            Number_Read(buffer);
+          else if (gdb->seqstate == NUMERIC)
+            { buffer[len] = 4;
+              if (stype == UPPER_CASE)
+                Upper_Read(buffer);
               else
-                Change_Read(buffer);
+                Lower_Read(buffer);
             }
+          else
+            Change_Read(buffer);
         }
+    }
 
-      if (stype == NUMERIC)
-        buffer[-1] = 4;
-      else if (stype == UPPER_CASE)
+  if (stype == NUMERIC)
+    buffer[-1] = 4;
+  else
+    { if (stype == UPPER_CASE)
         { int64 r, e, f, p;
 
           e = c[i+1].moff;
           for (r = c[i].moff; r < e; r++)
-            { f = masks[r].end - beg;
-              for (p = masks[r].beg - beg; p < f; p++)
+            { p = masks[r].beg;
+              f = masks[r].end;
+              if (p < beg)
+                p = beg;
+              if (f > end)
+                f = end;
+              for (p -= beg, f -= beg; p < f; p++)
                 buffer[p] += 32;
             }
-          buffer[-1] = '\0';
         }
-      else if (stype == LOWER_CASE)
-        buffer[-1] = '\0';
+      buffer[-1] = '\0';
+    }
+
+  return (buffer);
+}
 
+
+uint8 *Get_Contig_Bytes(GDB *gdb, int i, int beg, int end, uint8 *buffer)
+{ FILE       *b  = (FILE *) gdb->seqs;
+  uint8      *m  = (uint8 *) gdb->seqs;
+  GDB_CONTIG *c = gdb->contigs;
+  int64       off;
+  int         clen, bbeg;
+
+  if (m == NULL)
+    { EPRINTF(EPLACE,"%s: GDB has no sequence data (Get_Contig_Bytes)\n",Prog_Name);
+      EXIT(NULL);
+    }
+  if (gdb->seqstate != EXTERNAL && gdb->seqstate != COMPRESSED)
+    { EPRINTF(EPLACE,"%s: GDB sequences are not 2-bit compressed (Get_Contig_Bytes)\n",
+                     Prog_Name);
+      EXIT(NULL);
+    }
+  if (i < 0 || i >= gdb->ncontig)
+    { EPRINTF(EPLACE,"%s: Index %d out of bounds (Get_Contig_Bytes)\n",Prog_Name,i);
+      EXIT(NULL);
+    }
+  if (beg < 0 || end > c[i].clen || beg > end)
+    { EPRINTF(EPLACE,"%s: Subrange %d,%d out of bounds (Get_Contig_Bytes)\n",Prog_Name,beg,end);
+      EXIT(NULL);
+    }
+
+  bbeg = beg/4;
+  off  = c[i].boff + bbeg;
+  if (end > beg)
+    clen = ((end-1)/4+1) - bbeg;
+  else
+    clen = 0;
+
+  if (gdb->seqstate == COMPRESSED)
+    { if (buffer == NULL)
+        return (m + off);
+      memcpy(buffer,m + off,clen);
       return (buffer);
     }
 
+  if (buffer == NULL)
+    { EPRINTF(EPLACE,"%s: A buffer is needed when sequences are on disk (Get_Contig_Bytes)\n",
+                     Prog_Name);
+      EXIT(NULL);
+    }
   if (ftello(b) != off)
     fseeko(b,off,SEEK_SET);
   if (clen > 0)
     { if (fread(buffer,clen,1,b) != 1)
-        { EPRINTF(EPLACE,"%s: Failed read of GDB sequence file (Get_Contig_Piece)\n",Prog_Name);
+        { EPRINTF(EPLACE,"%s: Failed read of GDB sequence file (Get_Contig_Bytes)\n",Prog_Name);
           EXIT(NULL);
         }
     }
-  Uncompress_Read(4*clen,buffer);
-  buffer += beg%4;
-  buffer[len] = 4;
-  if (stype == NUMERIC)
-    buffer[-1] = 4;
-  else if (stype == LOWER_CASE)
-    { Lower_Read(buffer);
-      buffer[-1] = '\0';
-    }
-  else
-    { int64 r, e, f, p;
-
-      Upper_Read(buffer);
-      e = c[i+1].moff;
-      for (r = c[i].moff ; r < e; r++)
-        { f = masks[r].end - beg;
-          for (p = masks[r].beg - beg; p < f; p++)
-            buffer[p] += 32;
-        }
-      buffer[-1] = '\0';
-    }
-
   return (buffer);
 }
-
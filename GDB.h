@@ -74,6 +74,7 @@ typedef struct
     int           seqsrc;     //  One of the 4 file types below
     void         *seqs;       //  file pointer if EXTERNAL, mem pointer if not
                               //     NULL => not present
+    int64         seqmap;     //  > 0 => seqs is a read-only memory map of the .bps of this size
 
     float         freq[4];    //  frequency of A, C, G, T, respectively
   } GDB; 
@@ -115,6 +116,17 @@ typedef struct
 
 FILE **Get_GDB(GDB *gdb, char *source, char *cpath, int num_bps);
 
+  //  If dir is not NULL or empty then Get_GDB keeps the GDB it makes for a fasta or 1-seq
+  //     source (and num_bps > 0) in directory dir, named for the source's root and a key
+  //     hashed from its path, size, modification time, and samples of its content.  Later
+  //     calls for an unchanged source read this GDB instead of converting the source again.
+
+void Set_GDB_Cache(char *dir);
+
+  //  The directory set by Set_GDB_Cache, or NULL if none
+
+char *Get_GDB_Cache();
+
   //  Interpret source & target arguments returning complete path + extension names of
   //    the source and target in spath & tpath.  Returns the type of source.
   //  If target == NULL then tpath has the same path & root as spath
@@ -157,6 +169,13 @@ int Read_GDB(GDB *gdb, char *spath);
 
 int Load_Sequences(GDB *gdb, int stype);
 
+  // Memory map the .bps file of an EXTERNAL gdb in place of its file pointer.  Thereafter the
+  //   GDB is COMPRESSED, but the pages are only read in as touched, are shared with the OS
+  //   page cache, and may be read by any number of threads at once without a lock.
+  // In interactive mode, 1 is returned on error (the GDB is left unchanged), 0 otherwise.
+
+int Map_Sequences(GDB *gdb);
+
   // Write the given gdb to the file 'tpath'.  The GDB must have seqstate EXTERNAL and tpath
   //   must be consistent with the name of the .bps file.
 
@@ -196,8 +215,20 @@ char *Get_Contig(GDB *gdb, int i, int stype, char *buffer);
 
   // Like Get_Contig except that only the interval from beg to end is returned.
   // The UNCOMPRESSED format is not possible.  If buffer is NULL then one must
-  // note carefully that the piece will not be surrounded by sentinnel values.
+  // note carefully that the piece will not be surrounded by sentinnel values.  Otherwise
+  // exactly the bases of [beg,end) are decoded and returned starting at buffer[0], so buffer
+  // need only hold end-beg+1 bytes (plus the usual prefix byte for the sentinel before it).
 
 char *Get_Contig_Piece(GDB *gdb, int i, int beg, int end, int stype, char *buffer);
 
+  // Return the 2-bit compressed bytes of the interval from beg to end of the i'th contig,
+  // the first byte returned being the one that holds base 4*(beg/4).  Each byte holds 4
+  // bases, the first in its low order 2 bits.  The GDB's sequences must be EXTERNAL or
+  // COMPRESSED.  If buffer is NULL then the sequences must be COMPRESSED and a pointer
+  // into the in-memory block is returned, otherwise the bytes are copied (or read from
+  // the .bps file) into buffer which must hold at least (end-1)/4-beg/4+1 bytes.
+  // If an error occurs then NULL is returned in interactive mode.
+
+uint8 *Get_Contig_Bytes(GDB *gdb, int i, int beg, int end, uint8 *buffer);
+
 #endif // _GDB_DEFS
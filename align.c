@@ -60,6 +60,8 @@ typedef struct            //  Hidden from the user, working space for each threa
     void   *trace;
     int     alnmax;
     void   *alnpts;
+    int     bitmax;
+    void   *bitvec;
   } _Work_Data;
 
 Work_Data *New_Work_Data()
@@ -78,6 +80,8 @@ Work_Data *New_Work_Data()
   work->alnpts = NULL;
   work->celmax = 0;
   work->cells  = NULL;
+  work->bitmax = 0;
+  work->bitvec = NULL;
   return ((Work_Data *) work);
 }
 
@@ -133,6 +137,19 @@ static int enlarge_trace(_Work_Data *work, int newmax)
   return (0);
 }
 
+static int enlarge_bitvec(_Work_Data *work, int newmax)
+{ void *vec;
+  int   max;
+
+  max = ((int) (newmax*1.2)) + 10000;
+  vec = Realloc(work->bitvec,max,"Enlarging bit vector");
+  if (vec == NULL)
+    return(1);
+  work->bitmax = max;
+  work->bitvec = vec;
+  return (0);
+}
+
 void Free_Work_Data(Work_Data *ework)
 { _Work_Data *work = (_Work_Data *) ework;
   if (work->vector != NULL)
@@ -145,6 +162,8 @@ void Free_Work_Data(Work_Data *ework)
     free(work->points);
   if (work->alnpts != NULL)
     free(work->alnpts);
+  if (work->bitvec != NULL)
+    free(work->bitvec);
   free(work);
 }
 
@@ -5392,6 +5411,149 @@ static int middle_np(char *A, int M, char *B, int N, Trace_Waves *wave,
 }
 
 
+/****************************************************************************************\
+*                                                                                        *
+*  Bit-parallel tracing algorithm                                                        *
+*                                                                                        *
+\****************************************************************************************/
+
+/* Myers' 1999 bit-vector algorithm (in Hyyro's formulation) for the global alignment of
+     two substrings when A is no longer than a 128-bit word, as it is between trace points
+     at the usual spacing of 100.  The matrix is computed for the reversed substrings, so
+     that tracing an optimal path back from its far corner, preferring diagonal moves and
+     then deletions, walks forward from the start of A and B taking matches greedily much as
+     iter_np's furthest-reaching waves do, though not always choosing the same path among
+     equally good ones (see the note on Compute_Trace_PTS in align.h).  Bit i-1 of the vectors of column j holds the
+     vertical delta D[i][j]-D[i-1][j] of the unit-cost edit distance, and all N+1 columns
+     are kept for the trace back.  The indels of the path are pushed onto wave->Stop in the
+     same form as iter_np.  The number of differences is returned, or -1 if the alignment is
+     too poor for dmax (a sign of a bad trace point, as in iter_np).  As it does not place
+     ties as the other modes require, it is only used in GREEDIEST mode without a band.
+*/
+
+#define BIT_MAX  128
+#define BIT_RATE   8   //  below 1 difference in 8 bases the waves of iter_np are faster
+
+typedef unsigned __int128 Bit_Vector;
+
+static inline int bit_count(Bit_Vector x)
+{ return (__builtin_popcountll((uint64) x) + __builtin_popcountll((uint64) (x >> 64))); }
+
+//  D[i][j] from the vertical deltas of column j
+
+static inline int bit_cell(Bit_Vector *Pv, Bit_Vector *Mv, int i, int j)
+{ Bit_Vector mask;
+
+  if (i >= BIT_MAX)
+    mask = ~((Bit_Vector) 0);
+  else
+    mask = (((Bit_Vector) 1) << i) - 1;
+  return (j + bit_count(Pv[j] & mask) - bit_count(Mv[j] & mask));
+}
+
+static int bit_np(char *A, int M, char *B, int N, Trace_Waves *wave, _Work_Data *work, int dmax)
+{ Bit_Vector *Pv, *Mv;
+  int64       s;
+  int         diff;
+
+#ifdef DEBUG_ALIGN
+  printf("\n    BITS %ld,%ld: %d vs %d\n",A-wave->Aabs,B-wave->Babs,M,N);
+#endif
+
+  s = 2*(N+1)*sizeof(Bit_Vector);
+  if (s > work->bitmax)
+    if (enlarge_bitvec(work,s))
+      return (-1);
+  Pv = (Bit_Vector *) (work->bitvec);
+  Mv = Pv + (N+1);
+
+  //  Row i of column j is A[M-i] vs B[N-j]
+
+  { Bit_Vector Peq[4], Eq, Xv, Xh, Ph, Mh, P, Q;
+    int        i, j, c;
+
+    Peq[0] = Peq[1] = Peq[2] = Peq[3] = 0;
+    for (i = 0; i < M; i++)
+      if (A[M-1-i] < 4)
+        Peq[(int) A[M-1-i]] |= ((Bit_Vector) 1) << i;
+
+    P = ~((Bit_Vector) 0);
+    Q = 0;
+    Pv[0] = P;
+    Mv[0] = Q;
+    for (j = 0; j < N; j++)
+      { c = B[N-1-j];
+        if (c < 4)
+          Eq = Peq[c];
+        else
+          { Eq = 0;
+            for (i = 0; i < M; i++)
+              if (A[M-1-i] == c)
+                Eq |= ((Bit_Vector) 1) << i;
+          }
+        Xv = Eq | Q;
+        Xh = (((Eq & P) + P) ^ P) | Eq;
+        Ph = Q | ~(Xh | P);
+        Mh = P & Xh;
+        Ph = (Ph << 1) | 1;
+        Mh = Mh << 1;
+        P  = Mh | ~(Xv | Ph);
+        Q  = Ph & Xv;
+        Pv[j+1] = P;
+        Mv[j+1] = Q;
+      }
+  }
+
+  diff = bit_cell(Pv,Mv,M,N);
+  if (diff - abs(M-N) > dmax)
+    { fprintf(stderr,"%s: %s\n",Prog_Name,TP_Align);
+      return (-1);
+    }
+
+  { int ap = (wave->Aabs-A)-1;
+    int bp = (B-wave->Babs)+1;
+    int i, j, v, x;
+
+    i = M;
+    j = N;
+    v = diff;
+    while (i > 0 || j > 0)
+      { if (i > 0 && j > 0)
+          { if (A[M-i] == B[N-j])      //  a match is always on an optimal path
+              { i -= 1;
+                j -= 1;
+                continue;
+              }
+            x = bit_cell(Pv,Mv,i-1,j-1);
+            if (x + 1 == v)
+              { i -= 1;
+                j -= 1;
+                v  = x;
+                continue;
+              }
+          }
+        if (i > 0 && bit_cell(Pv,Mv,i-1,j) + 1 == v)
+          { *wave->Stop++ = bp+(N-j);
+            i -= 1;
+          }
+        else
+          { *wave->Stop++ = ap-(M-i);
+            j -= 1;
+          }
+        v -= 1;
+#ifdef DEBUG_SCRIPT
+        if (wave->Stop[-1] > 0)
+          printf("     D (%d)\n",wave->Stop[-1]);
+        else
+          printf("     I (%d)\n",wave->Stop[-1]);
+#endif
+      }
+  }
+
+  return (diff);
+}
+
+
 /****************************************************************************************\
 *                                                                                        *
 *  COMPUTE_TRACE FLAVORS                                                                 *
@@ -5414,6 +5576,7 @@ int Compute_Trace_PTS(Alignment *align, Work_Data *ework, int trace_spacing,
   int     ae, be;
   int     db, de;
   int     diffs, dmax;
+  int     bits;
 
   alen   = align->alen;
   blen   = align->blen;
@@ -5498,6 +5661,15 @@ int Compute_Trace_PTS(Alignment *align, Work_Data *ework, int trace_spacing,
         }
     }
 
+  //  The bit-parallel kernel takes time linear in the interval whereas that of iter_np grows
+  //    with its differences, so it is used for intervals that fit in a word whose trace point
+  //    records at least 1 difference per BIT_RATE bases, when ties need not be placed.
+  //    bit_np does not break ties between equally good paths as iter_np does, so the trace
+  //    produced (and every alignment shown or exported from it) changes if this choice of
+  //    kernel changes: only the number of differences is the same either way.
+
+  bits = (mode == GREEDIEST && dlow == -0x3fffffff && dhgh == 0x3fffffff);
+
   { int i, d;
 
     diffs = 0;
@@ -5513,7 +5685,10 @@ int Compute_Trace_PTS(Alignment *align, Work_Data *ework, int trace_spacing,
           { fprintf(stderr,"%s: %s\n",Prog_Name,TP_Error);
             return (1);
           }
-        d = iter_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,mode,dmax,dlow-db,dhgh-db);
+        if (bits && ae-ab <= BIT_MAX && ae > ab && points[i-1]*BIT_RATE >= ae-ab)
+          d = bit_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,work,dmax);
+        else
+          d = iter_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,mode,dmax,dlow-db,dhgh-db);
         if (d < 0)
           return (1);
         diffs += d;
@@ -5527,7 +5702,10 @@ int Compute_Trace_PTS(Alignment *align, Work_Data *ework, int trace_spacing,
       { fprintf(stderr,"%s: %s\n",Prog_Name,TP_Error);
         return (1);
       }
-    d = iter_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,mode,dmax,dlow-db,dhgh-db);
+    if (bits && ae-ab <= BIT_MAX && ae > ab && tlen >= 0 && points[tlen]*BIT_RATE >= ae-ab)
+      d = bit_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,work,dmax);
+    else
+      d = iter_np(aseq+ab,ae-ab,bseq+bb,be-bb,&wave,mode,dmax,dlow-db,dhgh-db);
     if (d < 0)
       return (1);
     diffs += d;
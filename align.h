@@ -251,6 +251,14 @@ void Complement_Seq(char *a, int n);
      by computing the trace between the mid-points of alignments between two adjacent pairs of trace
      points.  It is generally twice as slow as Compute_Trace_PTS, but it produces nearer optimal
      alignments.  Both these routines return 1 if an error occurred and 0 otherwise.
+
+     NB: In GREEDIEST mode without a diagonal restriction, Compute_Trace_PTS traces short
+     intervals with many differences with a bit-parallel kernel and the rest with the wave
+     algorithm.  Both find a path with the minimum number of differences between each pair
+     of trace points, but where there are several they can choose different ones, so the
+     exact trace (and hence an alignment displayed or exported from it) is NOT stable under
+     a change to which intervals take the bit-parallel kernel (BIT_MAX, BIT_RATE in align.c).
+     The number of differences is.
   */
 
 #define LOWERMOST -1   //   Possible modes for "mode" parameter below)
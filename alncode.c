@@ -179,6 +179,7 @@ endofsketch:
   gdb->seqtot   = seqtot;
   gdb->seqstate = EXTERNAL;
   gdb->seqs     = NULL;
+  gdb->seqmap   = 0;
 
   source += strlen(source);
   if (strcmp(source-3,".gz") == 0)
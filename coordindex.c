@@ -0,0 +1,96 @@
+/*******************************************************************************************
+ *
+ *  Global coordinate index of a GDB (see coordindex.h)
+ *
+ *  Node k of an Eytzinger array has children 2k and 2k+1, so the array is filled by an
+ *    in-order walk of this implicit tree over the sorted starts.  A search descends
+ *    to a leaf going right whenever a start is <= the coordinate, the bits of the final
+ *    node number then encode the path taken: shifting off the trailing 1's (right turns)
+ *    and one more bit gives the node of the first start > the coordinate, or 0 if none.
+ *
+ *******************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "coordindex.h"
+
+static int fill(int64 *key, int *rank, int n, int k, int64 *sorted, int i)
+{ if (k <= n)
+    { i = fill(key,rank,n,2*k,sorted,i);
+      key[k]  = sorted[i];
+      rank[k] = i++;
+      i = fill(key,rank,n,2*k+1,sorted,i);
+    }
+  return (i);
+}
+
+static int find(int64 *key, int *rank, int n, int64 coord)
+{ int k;
+
+  k = 1;
+  while (k <= n)
+    k = 2*k + (key[k] <= coord);
+  while (k & 0x1)
+    k >>= 1;
+  k >>= 1;
+  if (k == 0)
+    return (n-1);
+  return (rank[k]-1);
+}
+
+CoordIndex *New_Coord_Index(GDB *gdb)
+{ CoordIndex *index;
+  int64      *sorted;
+  int         ns, nc, s, c;
+
+  ns = gdb->nscaff;
+  nc = gdb->ncontig;
+
+  index  = (CoordIndex *) Malloc(sizeof(CoordIndex),"Allocating coordinate index");
+  sorted = (int64 *) Malloc(sizeof(int64)*((ns > nc ? ns : nc)+1),"Allocating coordinate index");
+  if (index == NULL || sorted == NULL)
+    { free(sorted);
+      free(index);
+      EXIT(NULL);
+    }
+  index->nscaff  = ns;
+  index->ncontig = nc;
+  index->sbeg    = (int64 *) Malloc(sizeof(int64)*(ns+1),"Allocating coordinate index");
+  index->srank   = (int *) Malloc(sizeof(int)*(ns+1),"Allocating coordinate index");
+  index->cbeg    = (int64 *) Malloc(sizeof(int64)*(nc+1),"Allocating coordinate index");
+  index->crank   = (int *) Malloc(sizeof(int)*(nc+1),"Allocating coordinate index");
+  if (index->sbeg == NULL || index->srank == NULL || index->cbeg == NULL || index->crank == NULL)
+    { free(sorted);
+      Free_Coord_Index(index);
+      EXIT(NULL);
+    }
+
+  for (s = 0; s < ns; s++)
+    sorted[s] = gdb->contigs[gdb->scaffolds[s].fctg].sbeg;
+  fill(index->sbeg,index->srank,ns,1,sorted,0);
+
+  for (c = 0; c < nc; c++)
+    sorted[c] = gdb->contigs[c].sbeg;
+  fill(index->cbeg,index->crank,nc,1,sorted,0);
+
+  free(sorted);
+
+  return (index);
+}
+
+void Free_Coord_Index(CoordIndex *index)
+{ if (index == NULL)
+    return;
+  free(index->crank);
+  free(index->cbeg);
+  free(index->srank);
+  free(index->sbeg);
+  free(index);
+}
+
+int Coord_Scaffold(CoordIndex *index, int64 coord)
+{ return (find(index->sbeg,index->srank,index->nscaff,coord)); }
+
+int Coord_Contig(CoordIndex *index, int64 coord)
+{ return (find(index->cbeg,index->crank,index->ncontig,coord)); }
@@ -0,0 +1,39 @@
+/*****************************************************************************************\
+*                                                                                         *
+*  Global coordinate index of a GDB                                                       *
+*                                                                                         *
+*  The global start of every scaffold and contig is kept in Eytzinger (breadth-first      *
+*  binary tree) order so that the scaffold or contig containing a global coordinate is    *
+*  found in O(log n) time with a cache-friendly, branch-free descent.  The contig sbeg     *
+*  fields of the GDB must already be global coordinates when the index is built.          *
+*                                                                                         *
+\*****************************************************************************************/
+
+#ifndef _COORD_INDEX
+#define _COORD_INDEX
+
+#include "gene_core.h"
+#include "GDB.h"
+
+typedef struct
+  { int     nscaff;
+    int64  *sbeg;    //  sbeg[1..nscaff] = scaffold starts in Eytzinger order
+    int    *srank;   //  srank[k] = index of the scaffold whose start is sbeg[k]
+    int     ncontig;
+    int64  *cbeg;    //  cbeg[1..ncontig] = contig starts in Eytzinger order
+    int    *crank;   //  crank[k] = index of the contig whose start is cbeg[k]
+  } CoordIndex;
+
+  //  Build the index of gdb.  Returns NULL with a message in EPLACE if out of memory.
+
+CoordIndex *New_Coord_Index(GDB *gdb);
+
+void Free_Coord_Index(CoordIndex *index);
+
+  //  Return the index of the last scaffold (contig) that starts at or before coord, or -1
+  //    if coord precedes them all
+
+int Coord_Scaffold(CoordIndex *index, int64 coord);
+int Coord_Contig(CoordIndex *index, int64 coord);
+
+#endif // _COORD_INDEX
@@ -1,24 +1,47 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "GDB.h"
 #include "doter.h"
 #include "sticks.h"
 
-#undef  DEBUG_CHECK
-#undef  DEBUG_STATS
-#undef  DEBUG_SHOW
 #undef  DEBUG_FILL
 
-static int build_vector(int64 len, char *seq, int kmer, Tuple *list)
-{ uint64 Kmask, Cumber[5];
-  int64  p, q, k, km1;
+static int TSORT(const void *l, const void *r)
+{ Tuple *x = (Tuple *) l;
+  Tuple *y = (Tuple *) r;
+  if (x->code < y->code)
+    return (-1);
+  if (x->code > y->code)
+    return (1);
+  return (0);
+}
+
+static void map(DotGDB *db, int64 coord, int *cps, int *pos)
+{ int c;
+
+  c = Coord_Contig(db->coords,coord);
+
+  *cps = c;
+  *pos = coord - db->gdb.contigs[c].sbeg;
+}
+
+//  Add the canonical k-mers of bases [beg,end) of a contig whose 2-bit bytes start at bytes
+//    (the byte holding base 4*(beg0/4)) to list[q..max), the position of each being its
+//    start plus off.  Returns the new size of the list.
+
+static int scan_kmers(uint8 *bytes, int beg0, int beg, int end, int64 off, int kmer,
+                      Tuple *list, int q, int max)
+{ uint64 Kmask, Cumber[4];
   uint64 u, c, x;
+  int    p, b, km1;
+
+  km1 = kmer-1;
+  if (end-beg < kmer)
+    return (q);
 
-  km1  = kmer-1;
-  len -= km1;
- 
   if (kmer == 32)
     Kmask = 0xffffffffffffffffllu;
   else
@@ -28,312 +51,593 @@ static int build_vector(int64 len, char *seq, int kmer, Tuple *list)
   Cumber[1] = (0x2llu << 2*km1);
   Cumber[2] = (0x1llu << 2*km1);
   Cumber[3] = 0x0llu;
-  Cumber[4] = 0x0llu;
 
+  bytes -= beg0/4;
   c = u = 0;
-  for (p = 0; p < km1; p++)
-    { x = seq[p];
+  for (p = beg; p < beg+km1; p++)
+    { x = (bytes[p>>2] >> ((p&0x3)<<1)) & 0x3;
       c = (c << 2) | x;
       u = (u >> 2) | Cumber[x];
     }
+  b = beg;
+  for (; p < end; p++)
+    { x = (bytes[p>>2] >> ((p&0x3)<<1)) & 0x3;
+      c = ((c << 2) | x) & Kmask;
+      u = (u >> 2) | Cumber[x];
+      if (q >= max)
+        break;
+      if (u < c)
+        list[q].code = u;
+      else
+        list[q].code = c;
+      list[q++].pos = off + (b++);
+    }
+  return (q);
+}
+
+//  Build the list of canonical k-mers in the interval [vbeg,vend) of the global coordinates
+//    of db, taking them directly from the 2-bit encoded sequence of each contig that
+//    overlaps the interval.  No k-mer spans a contig boundary (i.e. a gap or the start of a
+//    new scaffold) and if mask is set no k-mer includes a soft-masked base.  bytes is a
+//    buffer of MAX_DOTPLOT/4+2 bytes for sequence read from disk.  Returns the list size.
+
+static int build_vector(DotGDB *db, int64 vbeg, int64 vend, int kmer, int mask,
+                        uint8 *bytes, Tuple *list)
+{ GDB        *gdb   = &(db->gdb);
+  GDB_CONTIG *ctg   = gdb->contigs;
+  GDB_MASK   *masks = gdb->masks;
+  int         cpb, cpe;
+  int         beg, end;
+  int         c, q, max;
+  int         cb, ce, p;
+  int64       r, e;
+  uint8      *seq;
+
+  if (gdb->nmasks == 0)
+    mask = 0;
+  if (vend - vbeg > MAX_DOTPLOT)
+    vend = vbeg + MAX_DOTPLOT;
+  max = MAX_DOTPLOT;
+
+  map(db,vbeg,&cpb,&beg);
+  map(db,vend,&cpe,&end);
+
   q = 0;
-  k = 0;
-  seq += km1;
-  for (p = 0; p < len; p++)
-    { x = seq[p];
-      if (x >= 4)
-        { k = p+kmer;
-          c = u = 0;
+  for (c = cpb; c <= cpe; c++)
+    { cb = 0;
+      ce = ctg[c].clen;
+      if (c == cpb)
+        cb = beg;
+      if (c == cpe && end < ce)
+        ce = end;
+      if (ce - cb < kmer)
+        continue;
+
+      if (gdb->seqstate == EXTERNAL)
+        { pthread_mutex_lock(&(db->lock));
+          seq = Get_Contig_Bytes(gdb,c,cb,ce,bytes);
+          pthread_mutex_unlock(&(db->lock));
         }
       else
-        { c = ((c << 2) | x) & Kmask;
-          u = (u >> 2) | Cumber[x];
-          if (p >= k)
-            { if (u < c)
-                list[q].code = u;
-              else
-                list[q].code = c;
-              list[q++].pos = p;
+        seq = Get_Contig_Bytes(gdb,c,cb,ce,NULL);
+      if (seq == NULL)
+        continue;
+
+      p = cb;
+      if (mask)
+        { e = ctg[c+1].moff;
+          for (r = ctg[c].moff; r < e; r++)
+            { if (masks[r].end <= p)
+                continue;
+              if (masks[r].beg >= ce)
+                break;
+              if (masks[r].beg > p)
+                q = scan_kmers(seq,cb,p,masks[r].beg,ctg[c].sbeg-vbeg,kmer,list,q,max);
+              p = masks[r].end;
             }
         }
+      if (p < ce)
+        q = scan_kmers(seq,cb,p,ce,ctg[c].sbeg-vbeg,kmer,list,q,max);
     }
-  return ((int) q);
+  return (q);
 }
 
-static int merge(int brun, Tuple *blist, int arun, Tuple *alist)
-{ int    *aplot;
-  int     i, j;
-  int     al, bl;
-  int     al2, bl2;
-  int     y;
-  uint64  kb, lc, anull;
-
-  bl = brun;
-  al = arun;
-
-  lc = alist[al-1].code;
-  for (bl2 = bl-1; bl2 >= 0; bl2--)
-    if (blist[bl2].code < lc)
-      break;
-  bl2 += 1;
-  for (al2 = al-2; al2 >= 0; al2--)
-    if (alist[al2].code < lc)
-      break;
-  al2 += 1;
-
-  aplot = (int *) alist;
-  anull = 2*al-1;
-
-  y = 0;
+void *dotplot_memory()
+{ return (malloc(sizeof(Tuple)*2*MAX_DOTPLOT + (MAX_DOTPLOT/4+2))); }
+
+
+/*******************************************************************************************
+ *
+ *  FUSED RASTER KERNEL
+ *
+ *  dotraster joins the sorted k-mer lists and deposits each hit directly into an 8-bit
+ *    hit-count raster, avoiding any intermediate hit list and any per-hit QPainter call.
+ *    After sorting, the positions are converted in place to pixel coordinates, and then
+ *    the rows of the plot frame are divided into horizontal bands, one per thread.  Every
+ *    thread walks the (read-only) joined lists, but only deposits the part of each hit
+ *    diagonal that falls in its band, so no two threads ever write the same pixel.
+ *
+ *  A k-mer that occurs more than cap times on either axis in the view (e.g. in a tandem
+ *    repeat or satellite) would produce a quadratic number of hits, it is skipped and
+ *    counted instead.  If mask is set, soft-masked bases break k-mers just like N's.
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { Tuple        *alist;
+    Tuple        *blist;
+    int           arun, brun;
+    int           cap;      //  skip k-mers with more than cap occurrences on an axis (0 = none)
+    int           klen;     //  length in pixels of a hit diagonal (>= 1)
+    int           ybeg;     //  rows [ybeg,yend) of the raster belong to this band
+    int           yend;
+    int           xend;     //  columns >= xend are outside the plot frame
+    uint8        *raster;
+    int64         stride;
+    volatile int *cancel;
+    int64         nhit;
+    int64         ncap;
+    int64         ncapped;
+  } Band;
+
+static void *band_raster(void *arg)
+{ Band  *parm   = (Band *) arg;
+  Tuple *alist  = parm->alist;
+  Tuple *blist  = parm->blist;
+  int    arun   = parm->arun;
+  int    brun   = parm->brun;
+  int    cap    = parm->cap;
+  int    klen   = parm->klen;
+  int    ybeg   = parm->ybeg;
+  int    yend   = parm->yend;
+  int    xend   = parm->xend;
+  uint8 *raster = parm->raster;
+  int64  stride = parm->stride;
+
+  int    i, j, ie, je;
+  int    p, q, x, y, d;
+  int    d0, d1, e1;
+  int64  nhit, ncap, ncapped;
+  uint64 kb;
+  uint8 *r;
+
+  nhit = ncap = ncapped = 0;
   i = j = 0;
-  while (i < bl2)
+  while (i < brun && j < arun)
     { kb = blist[i].code;
-      while (alist[j].code < kb)
-        j += 1;
-
-      if (alist[j].code == kb)
-        { blist[i++].code = y;
-          while (blist[i].code == kb)
-            blist[i++].code = y;
-          aplot[y++] = alist[j++].pos;
-          while (alist[j].code == kb)
-            aplot[y++] = alist[j++].pos;
-          aplot[y++] = -1;
+      if (alist[j].code < kb)
+        { j += 1;
+          continue;
         }
-      else
-        { blist[i++].code = anull;
-          while (blist[i].code == kb)
-            blist[i++].code = anull;
+      if (alist[j].code > kb)
+        { i += 1;
+          continue;
         }
-    }
 
-  if (bl2 < bl && blist[i].code == lc)
-    { blist[i++].code = y;
-      while (i < bl && blist[i].code == lc)
-        blist[i++].code = y;
-      while (al2 < al)
-        aplot[y++] = alist[al2++].pos;
-      aplot[y++] = -1;
+      for (ie = i+1; ie < brun; ie++)
+        if (blist[ie].code != kb)
+          break;
+      for (je = j+1; je < arun; je++)
+        if (alist[je].code != kb)
+          break;
+
+      if (*(parm->cancel))
+        break;
+
+      if (cap > 0 && (ie-i > cap || je-j > cap))
+        { ncap    += 1;
+          ncapped += ((int64) (ie-i))*(je-j);
+          i = ie;
+          j = je;
+          continue;
+        }
+
+      for (p = i; p < ie; p++)
+        { y = blist[p].pos;
+          if (y >= yend || y+klen <= ybeg)
+            continue;
+          d0 = ybeg-y;
+          if (d0 < 0)
+            d0 = 0;
+          d1 = yend-y;
+          if (d1 > klen)
+            d1 = klen;
+          for (q = j; q < je; q++)
+            { x  = alist[q].pos;
+              e1 = xend-x;
+              if (e1 > d1)
+                e1 = d1;
+              r = raster + (y+d0)*stride + (x+d0);
+              for (d = d0; d < e1; d++)
+                { if (*r < 255)
+                    *r += 1;
+                  r += stride+1;
+                }
+              if (d0 == 0)
+                nhit += 1;
+            }
+        }
+
+      i = ie;
+      j = je;
     }
-  while (i < bl)
-    blist[i++].code = anull;
-  aplot[anull] = -1;
 
-  return (y);
+  parm->nhit    = nhit;
+  parm->ncap    = ncap;
+  parm->ncapped = ncapped;
+  return (NULL);
 }
 
-static int TSORT(const void *l, const void *r)
-{ Tuple *x = (Tuple *) l;
-  Tuple *y = (Tuple *) r;
-  if (x->code < y->code)
-    return (-1);
-  if (x->code > y->code)
-    return (1);
-  return (0);
+/*******************************************************************************************
+ *
+ *  INDEXED RASTER KERNEL
+ *
+ *  When both genomes have a minimizer index for the k-mer size, the minimizers in the view
+ *    are found by binary search in the position sorted lists, those of the A-range are put
+ *    in a hash table chained by code, and each B-minimizer is then looked up and its hits
+ *    deposited.  As the B-list is in position order, each band only visits a contiguous
+ *    stretch of it.  Nothing is decoded or sorted, so any view is fast.
+ *
+ *  To bound the memory of the hash table, when either axis of the view has more than
+ *    MAX_INDEX_VIEW minimizers only those whose code hashes into the top 1/2^s of a second
+ *    hash are used, s the least giving at most about MAX_INDEX_VIEW per axis.  As the choice
+ *    depends only on the code, a sampled k-mer keeps all of its hits on both axes (and its
+ *    occurrence counts for the cap are exact), the plot simply shows 1 in 2^s k-mers.
+ *
+ ********************************************************************************************/
+
+#define MAX_INDEX_VIEW 2000000
+
+static inline int unsampled(uint32 code, int shift)
+{ return (shift > 0 && ((code * 0x85ebca6bu) >> (32-shift)) != 0); }
+
+typedef struct
+  { DotIndexK    *ia, *ib;
+    int64         abeg, bbeg, bend;
+    int64         vX, vY;
+    double        xa, ya;
+    int           mask;
+    int           cap;
+    int           shift;    //  only k-mers for which ! unsampled(code,shift) are used
+    int64        *aspot;    //  positions of the A-minimizers in the hash table
+    int           hmask;    //  hash table size - 1
+    uint32       *hcode;
+    int          *hhead;    //  first A-minimizer in chain, -1 if slot empty
+    int          *hacnt;
+    int          *hbcnt;
+    int          *next;     //  next A-minimizer in chain, -1 at end
+    int           klen;
+    int           ybeg;
+    int           yend;
+    int           xend;
+    uint8        *raster;
+    int64         stride;
+    volatile int *cancel;
+    int64         nhit;
+  } IBand;
+
+static inline int hash_slot(uint32 code, int hmask, uint32 *hcode, int *hhead)
+{ int h = (int) ((code * 0x9e3779b1u) & hmask);
+
+  while (hhead[h] >= 0 && hcode[h] != code)
+    h = (h+1) & hmask;
+  return (h);
 }
 
-static void map(GDB *gdb, int64 coord, int *cps, int *pos)
-{ GDB_SCAFFOLD *scf;
-  GDB_CONTIG   *ctg;
-  int           i, s, c;
-
-  scf = gdb->scaffolds;
-  ctg = gdb->contigs;
-
-  for (i = 0; i < gdb->nscaff; i++)       //  binary search instead ?
-    if (ctg[scf[i].fctg].sbeg > coord)
-      break;
-  s = i-1;
-
-  for (i = scf[s].fctg; i < scf[s].ectg; i++)
-    if (ctg[i].sbeg > coord)
-      break;
-  c = i-1;
+static void *index_band(void *arg)
+{ IBand  *parm   = (IBand *) arg;
+  int64  *aspot  = parm->aspot;
+  int64  *bspot  = parm->ib->spot;
+  uint32 *bcode  = parm->ib->code;
+  int     cap    = parm->cap;
+  int     klen   = parm->klen;
+  int     ybeg   = parm->ybeg;
+  int     yend   = parm->yend;
+  int     xend   = parm->xend;
+  uint8  *raster = parm->raster;
+  int64   stride = parm->stride;
+
+  int64   i, nhit;
+  int     h, q, x, y, d;
+  int     d0, d1, e1;
+  uint8  *r;
+
+  nhit = 0;
+  for (i = parm->bbeg; i < parm->bend; i++)
+    { if ((i & 0xffff) == 0 && *(parm->cancel))
+        break;
+      y = (int) floor(parm->ya*((bspot[i] >> 1) - parm->vY) + 22.);
+      if (y >= yend)
+        break;
+      if (y+klen <= ybeg || (parm->mask && (bspot[i] & 0x1)) || unsampled(bcode[i],parm->shift))
+        continue;
+      h = hash_slot(bcode[i],parm->hmask,parm->hcode,parm->hhead);
+      if (parm->hhead[h] < 0)
+        continue;
+      if (cap > 0 && (parm->hacnt[h] > cap || parm->hbcnt[h] > cap))
+        continue;
+
+      d0 = ybeg-y;
+      if (d0 < 0)
+        d0 = 0;
+      d1 = yend-y;
+      if (d1 > klen)
+        d1 = klen;
+      for (q = parm->hhead[h]; q >= 0; q = parm->next[q])
+        { x  = (int) floor(parm->xa*((aspot[q] >> 1) - parm->vX) + 22.);
+          e1 = xend-x;
+          if (e1 > d1)
+            e1 = d1;
+          r = raster + (y+d0)*stride + (x+d0);
+          for (d = d0; d < e1; d++)
+            { if (*r < 255)
+                *r += 1;
+              r += stride+1;
+            }
+          if (d0 == 0)
+            nhit += 1;
+        }
+    }
 
-  *cps = c;
-  *pos = coord - ctg[c].sbeg;
+  parm->nhit = nhit;
+  return (NULL);
 }
 
-static int runOfN(int len, char *seq)
-{ int i;
+static int index_raster(DotIndexK *ia, DotIndexK *ib, int cap, int mask, View *view,
+                        int nthreads, int rectW, int rectH, uint8 *raster, int64 stride,
+                        DotCounts *counts, volatile int *cancel)
+{ int64   abeg, aend, bbeg, bend;
+  int64   na, i, j;
+  int     kmer, hsize, hmask, h, n, shift;
+  uint32 *hcode;
+  int    *hhead, *hacnt, *hbcnt, *next;
+  int64  *aspot;
+
+  IBand     parm[nthreads];
+  pthread_t threads[nthreads];
+
+  kmer = ia->kmer;
+  Dot_Index_Range(ia,view->x,view->x+view->w-(kmer-1),&abeg,&aend);
+  Dot_Index_Range(ib,view->y,view->y+view->h-(kmer-1),&bbeg,&bend);
+
+  counts->nhit    = 0;
+  counts->ncap    = 0;
+  counts->ncapped = 0;
+
+  na = aend-abeg;
+  if (bend-bbeg > na)
+    na = bend-bbeg;
+  for (shift = 0; (na >> shift) > MAX_INDEX_VIEW; shift++)
+    continue;
+  counts->sample = (1 << shift);
+
+  if (shift == 0)
+    na = aend-abeg;
+  else
+    { na = 0;
+      for (i = abeg; i < aend; i++)
+        if ( ! unsampled(ia->code[i],shift))
+          na += 1;
+    }
 
-  for (i = 0; i < len; i++)
-    seq[i] = 4;
-  return (len);
-}
+  hsize = 1024;
+  while (hsize < 2*na)
+    hsize <<= 1;
+  hmask = hsize-1;
+
+  hcode = malloc(sizeof(uint32)*hsize);
+  hhead = malloc(sizeof(int)*hsize);
+  hacnt = malloc(sizeof(int)*hsize);
+  hbcnt = malloc(sizeof(int)*hsize);
+  next  = malloc(sizeof(int)*(na+1));
+  if (shift == 0)
+    aspot = ia->spot + abeg;
+  else
+    aspot = malloc(sizeof(int64)*(na+1));
+  if (hcode == NULL || hhead == NULL || hacnt == NULL || hbcnt == NULL || next == NULL
+                    || aspot == NULL)
+    { if (shift > 0)
+        free(aspot);
+      free(next);
+      free(hbcnt);
+      free(hacnt);
+      free(hhead);
+      free(hcode);
+      return (-1);
+    }
+  for (h = 0; h < hsize; h++)
+    { hhead[h] = -1;
+      hacnt[h] = hbcnt[h] = 0;
+    }
 
-static char *build_string(GDB *gdb, int64 vbeg, int64 vend, char *seq)
-{ GDB_CONTIG *ctg;
-  int cpb, cpe;
-  int beg, end;
-  int s, c, x;
+  j = 0;
+  for (i = abeg; i < aend; i++)
+    { if (unsampled(ia->code[i],shift))
+        continue;
+      if (shift > 0)
+        aspot[j] = ia->spot[i];
+      if ( ! (mask && (ia->spot[i] & 0x1)))
+        { h = hash_slot(ia->code[i],hmask,hcode,hhead);
+          hcode[h] = ia->code[i];
+          next[j]  = hhead[h];
+          hhead[h] = (int) j;
+          hacnt[h] += 1;
+        }
+      j += 1;
+    }
+  for (i = bbeg; i < bend; i++)
+    { if ((mask && (ib->spot[i] & 0x1)) || unsampled(ib->code[i],shift))
+        continue;
+      h = hash_slot(ib->code[i],hmask,hcode,hhead);
+      if (hhead[h] >= 0)
+        hbcnt[h] += 1;
+    }
 
-  ctg = gdb->contigs;
+  if (cap > 0)
+    for (h = 0; h < hsize; h++)
+      if (hbcnt[h] > 0 && (hacnt[h] > cap || hbcnt[h] > cap))
+        { counts->ncap    += 1;
+          counts->ncapped += ((int64) hacnt[h])*hbcnt[h];
+        }
 
-  map(gdb,vbeg,&cpb,&beg);
-  map(gdb,vend,&cpe,&end);
+  n = rectH-44;
+  for (i = 0; i < nthreads; i++)
+    { parm[i].ia     = ia;
+      parm[i].ib     = ib;
+      parm[i].abeg   = abeg;
+      parm[i].bbeg   = bbeg;
+      parm[i].bend   = bend;
+      parm[i].vX     = view->x;
+      parm[i].vY     = view->y;
+      parm[i].xa     = (rectW-44.)/view->w;
+      parm[i].ya     = (rectH-44.)/view->h;
+      parm[i].mask   = mask;
+      parm[i].cap    = cap;
+      parm[i].shift  = shift;
+      parm[i].aspot  = aspot;
+      parm[i].hmask  = hmask;
+      parm[i].hcode  = hcode;
+      parm[i].hhead  = hhead;
+      parm[i].hacnt  = hacnt;
+      parm[i].hbcnt  = hbcnt;
+      parm[i].next   = next;
+      parm[i].klen   = kmer*parm[i].xa;
+      if (parm[i].klen < 1)
+        parm[i].klen = 1;
+      parm[i].ybeg   = 22 + (((int64) n)*i)/nthreads;
+      parm[i].yend   = 22 + (((int64) n)*(i+1))/nthreads;
+      parm[i].xend   = rectW-22;
+      parm[i].raster = raster;
+      parm[i].stride = stride;
+      parm[i].cancel = cancel;
+    }
 
-  // printf(" %d,%d - %d,%d\n",cpb,beg,cpe,end);
+  //  Start each band at the first B-minimizer whose diagonal can reach it
 
-  if (cpb == cpe)
-    seq = Get_Contig_Piece(gdb,cpb,beg,end,NUMERIC,seq);
-  else
-    { seq = Get_Contig_Piece(gdb,cpb,beg,ctg[cpb].clen,NUMERIC,seq);
-      s = ctg[cpb].scaf;
-      x = ctg[cpb].clen - beg;
-      for (c = cpb+1; c < cpe; c++)
-        { if (ctg[c].scaf == s)
-            x += runOfN(ctg[c].sbeg-(ctg[c-1].sbeg+ctg[c-1].clen),seq+x);
-          Get_Contig(gdb,c,NUMERIC,seq+x);
-          s = ctg[c].scaf;
-          x += ctg[c].clen;
+  for (i = 1; i < nthreads; i++)
+    { int64 l = bbeg, r = bend, m;
+      int64 p = view->y + (int64) floor((parm[i].ybeg - 22 - parm[i].klen) / parm[i].ya) - 1;
+
+      while (l < r)
+        { m = (l+r)/2;
+          if ((ib->spot[m] >> 1) < p)
+            l = m+1;
+          else
+            r = m;
         }
-      if (ctg[cpe].scaf == s)
-        x += runOfN(ctg[cpe].sbeg-(ctg[cpe-1].sbeg+ctg[cpe-1].clen),seq+x);
-      Get_Contig_Piece(gdb,c,0,end,NUMERIC,seq+x);
+      parm[i].bbeg = l;
     }
-  return (seq);
+
+  for (i = 1; i < nthreads; i++)
+    pthread_create(threads+i,NULL,index_band,parm+i);
+  index_band(parm);
+  for (i = 1; i < nthreads; i++)
+    pthread_join(threads[i],NULL);
+
+  if (shift > 0)
+    free(aspot);
+  free(next);
+  free(hbcnt);
+  free(hacnt);
+  free(hhead);
+  free(hcode);
+
+  if (*cancel)
+    return (-1);
+
+  for (i = 0; i < nthreads; i++)
+    counts->nhit += parm[i].nhit;
+  return (0);
 }
 
-void *dotplot_memory()
-{ return (malloc((sizeof(Tuple)+1)*2*MAX_DOTPLOT + 8 + sizeof(Dots))); }
+int dotindexed(DotPlot *plot, int kmer)
+{ return (Dot_Index_Kmer(plot->db1->index,kmer) != NULL &&
+          Dot_Index_Kmer(plot->db2->index,kmer) != NULL);
+}
 
-Dots *dotplot(DotPlot *plot, int kmer, View *view)
-{ Dots  *dot   = (Dots *) plot->dotmemory;
-  Tuple *alist = (Tuple *) (dot+1);
+int dotraster(DotPlot *plot, void *memory, int kmer, int cap, int mask, View *view,
+              int nthreads, int rectW, int rectH, uint8 *raster, int64 stride,
+              DotCounts *counts, volatile int *cancel)
+{ Tuple *alist = (Tuple *) memory;
   Tuple *blist = alist + MAX_DOTPLOT;
-  char  *aseq  = (char *) (blist+MAX_DOTPLOT);
-  char  *bseq  = aseq + (MAX_DOTPLOT+4);
-  int   *aplot = (int *) alist;
+  uint8 *bytes = (uint8 *) (blist+MAX_DOTPLOT);
 
-  int    arun, brun, ahit;
+  int    arun, brun;
+  int    i, h, klen;
 
   int64 vX = view->x;
   int64 vY = view->y;
   int64 vW = view->w;
   int64 vH = view->h;
 
-  // double xa = (rectH-44.)/vH;
-  // double xb = 22.;
-  // double ya = (rectW-44.)/vW;
-  // double yb = 22.;
+  double xa = (rectW-44.)/vW;
+  double ya = (rectH-44.)/vH;
+
+  Band      parm[nthreads];
+  pthread_t threads[nthreads];
 
-  // printf(" %lld-%lld vs %lld-%lld %d\n",vX,vX+vW,vY,vY+vH,kmer);
+  { DotIndexK *ia = Dot_Index_Kmer(plot->db1->index,kmer);
+    DotIndexK *ib = Dot_Index_Kmer(plot->db2->index,kmer);
 
-  aseq = build_string(&(plot->db1->gdb),vX,vX+vW,aseq);
-  bseq = build_string(&(plot->db2->gdb),vY,vY+vH,bseq);
+    if (ia != NULL && ib != NULL)
+      return (index_raster(ia,ib,cap,mask,view,nthreads,rectW,rectH,raster,stride,counts,cancel));
+  }
 
-  arun = build_vector(vW,aseq,kmer,alist);
-  brun = build_vector(vH,bseq,kmer,blist);
+  arun = build_vector(plot->db1,vX,vX+vW,kmer,mask,bytes,alist);
+  if (*cancel)
+    return (-1);
+  brun = build_vector(plot->db2,vY,vY+vH,kmer,mask,bytes,blist);
+  if (*cancel)
+    return (-1);
 
   qsort(alist,arun,sizeof(Tuple),TSORT);
+  if (*cancel)
+    return (-1);
   qsort(blist,brun,sizeof(Tuple),TSORT);
+  if (*cancel)
+    return (-1);
 
-#ifdef DEBUG_CHECK
-  { int i;
-
-    for (i = 1; i < arun; i++)
-      if (alist[i].code < alist[i-1].code)
-        printf("Not sorted\n");
-
-    for (i = 1; i < brun; i++)
-      if (blist[i].code < blist[i-1].code)
-        printf("Not sorted\n");
-  }
-#endif
-
-  ahit = merge(brun,blist,arun,alist);
-
-#ifdef DEBUG_SHOW
-  { int i, j;
-
-    printf("Scan Lines:\n");
-    for (i = 0; i < brun; i++)
-      { printf(" %5d:",blist[i].pos);
-        j = blist[i].code;
-        while (aplot[j] >= 0)
-          { printf(" %5d",aplot[j]);
-            j += 1;
-          }
-        printf("\n");
-      }
-  }
-#endif
-
-#ifdef DEBUG_CHECK
-  { int i, j;
-    int amax = vW - (kmer-1);
-
-    for (i = 0; i < brun; i++)
-      { j = blist[i].code;
-        if (j >= ahit && j != 2*arun-1)
-          printf("bcode val out of bounds\n");
-        while (aplot[j] >= 0)
-          { if (aplot[j] > amax)
-              printf("aplot val out of bounds\n");
-            j += 1;
-          }
-        if (aplot[j] != -1)
-          printf("aplot terminator is not -1\n");
-      }
-  }
-#endif
-  
-#ifdef DEBUG_STATS
-  { int i, j;
-    int nz, nel;
-
-    printf("Scan Stats:\n");
-    nz = nel = 0;
-    for (i = 0; i < brun; i++)
-      { j = blist[i].code;
-        if (aplot[j] >= 0)
-          { nz += 1;
-            while (aplot[j] >= 0)
-              { nel += 1;
-                j += 1;
-              }
-          }
-      }
-
-    printf("  Non-Zero lines: %d (out of %d)\n",nz,blen);
-    printf("  Av/line = %.1f (out of %d)\n",(1.*nel)/alen,alen);
-    printf("  Density = %.3f%%\n",((100.*nel)/alen)/blen);
-  }
-#endif
-
-  dot->ahit  = ahit;
-  dot->brun  = brun;
-  dot->aplot = aplot;
-  dot->blist = blist;
-
-/*
-  // printf("Paint = (%lld,%lld) %lld x %lld into %d x %d\n",vX,vY,vW,vH,rectW,rectH);
+  for (i = 0; i < arun; i++)
+    alist[i].pos = (int) floor(xa*alist[i].pos+22.);
+  for (i = 0; i < brun; i++)
+    blist[i].pos = (int) floor(ya*blist[i].pos+22.);
+
+  klen = kmer*xa;
+  if (klen < 1)
+    klen = 1;
+
+  h = rectH-44;
+  for (i = 0; i < nthreads; i++)
+    { parm[i].alist  = alist;
+      parm[i].blist  = blist;
+      parm[i].arun   = arun;
+      parm[i].brun   = brun;
+      parm[i].cap    = cap;
+      parm[i].klen   = klen;
+      parm[i].ybeg   = 22 + (((int64) h)*i)/nthreads;
+      parm[i].yend   = 22 + (((int64) h)*(i+1))/nthreads;
+      parm[i].xend   = rectW-22;
+      parm[i].raster = raster;
+      parm[i].stride = stride;
+      parm[i].cancel = cancel;
+    }
 
-  { int i, x;
+  for (i = 1; i < nthreads; i++)
+    pthread_create(threads+i,NULL,band_raster,parm+i);
+  band_raster(parm);
+  for (i = 1; i < nthreads; i++)
+    pthread_join(threads[i],NULL);
 
-    for (i = 0; i < ahit; i++)
-      { x = aplot[i];
-        if (x >= 0)
-          aplot[i] = ((int) floor(xa*x+xb));
-      }
-  }
+  if (*cancel)
+    return (-1);
 
-  { int i, k, u;
-    uint8 *ras;
-
-    for (i = 0; i < brun; i++)
-      { ras = raster[((int) floor(ya*blist[i].pos+yb))];
-        k = blist[i].code;
-        while (1)
-          { u = aplot[k++];
-            if (u < 0) 
-              break;
-            ras[u] = 255;
-          }
-      }
-  }
-*/
+  //  Every band sees the same k-mer runs, so the cap counts of any one of them will do
 
-  return (dot);
+  counts->nhit    = 0;
+  for (i = 0; i < nthreads; i++)
+    counts->nhit += parm[i].nhit;
+  counts->ncap    = parm[0].ncap;
+  counts->ncapped = parm[0].ncapped;
+  counts->sample  = 1;
+  return (0);
 }
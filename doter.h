@@ -6,6 +6,9 @@
 
 #define MAX_DOTPLOT 1000000
 
+  //  dotplot_memory returns a working buffer big enough for one dot plot computation.  Each
+  //    job that may run concurrently with another must have its own, the caller frees it.
+
 void *dotplot_memory();
 
 typedef struct 
@@ -14,13 +17,32 @@ typedef struct
   } Tuple;
 
 typedef struct
-  { int    ahit, brun;
-    int   *aplot;
-    Tuple *blist;
-  } Dots;
-
-Dots *dotplot(DotPlot *plot, int kmer, View *view);
-
-// Dots *dotplot(DotPlot *plot, int kmer, View *view, int rectW, int rectH, uint8 **raster);
+  { int64  nhit;      //  # of hits added to the raster
+    int64  ncap;      //  # of distinct k-mers suppressed by the occurrence cap
+    int64  ncapped;   //  # of hits those k-mers would have produced
+    int    sample;    //  only 1 in sample k-mers was plotted (1 unless from a large index view)
+  } DotCounts;
+
+  //  dotraster computes the k-mer matches for view and adds each one directly into raster,
+  //    an 8-bit hit count image of rectW x rectH pixels (rows stride bytes apart) that the
+  //    caller has zeroed.  Each hit is a diagonal kmer bases long, counts saturate at 255,
+  //    and the rows of the plot frame are split into bands over nthreads threads.  K-mers
+  //    occurring more than cap times on either axis are suppressed (cap = 0 for no limit),
+  //    and if mask is set then soft-masked bases are excluded.  Returns 0 with the totals
+  //    in counts, or -1 if *cancel became non-zero while it was running.
+  //
+  //  If both genomes have a minimizer index for kmer (see dotindex.h) then only minimizer
+  //    hits are plotted, but they are found directly from the index without decoding any
+  //    sequence, so views larger than MAX_DOTPLOT are possible.  In a view with too many
+  //    minimizers to join in bounded memory, a subset of the k-mers is plotted, 1 in
+  //    counts->sample of them.
+
+int dotraster(DotPlot *plot, void *memory, int kmer, int cap, int mask, View *view,
+              int nthreads, int rectW, int rectH, uint8 *raster, int64 stride,
+              DotCounts *counts, volatile int *cancel);
+
+  //  dotindexed returns non-zero if both genomes of plot have a minimizer index for kmer
+
+int dotindexed(DotPlot *plot, int kmer);
 
 #endif
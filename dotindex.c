@@ -0,0 +1,542 @@
+/*******************************************************************************************
+ *
+ *  Minimizer index of a GDB for the k-mer dot plot layer (see dotindex.h)
+ *
+ *  Index file layout (native byte order):
+ *
+ *     char   magic[8]                         "DOTIDX2"
+ *     int64  seqtot, ncontig, nk              must match the GDB when opened
+ *     int64  srcsize, srcmtime                must match the GDB's source file when opened
+ *     int64  kmer, window, nmin, soff, coff   for each of the nk k-mer sizes
+ *     ...    spot & code arrays               at byte offsets soff & coff
+ *
+ *******************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "gene_core.h"
+#include "GDB.h"
+#include "dotindex.h"
+
+#define MAGIC "DOTIDX2"
+
+#define HEAD_FIX 6   //  # of int64's in the header before those of each k-mer size
+
+int IndexKmers[INDEX_NKMERS] = { 12, 14, 16 };
+
+//  Set *size and *mtime to those of the source file of gdb, returning 0 if it cannot be stat'ed,
+//    so that an index built before the GDB was remade from edited sequence is not used
+
+static int source_stamp(GDB *gdb, int64 *size, int64 *mtime)
+{ struct stat info;
+
+  if (stat(gdb->srcpath,&info) < 0)
+    return (0);
+  *size  = info.st_size;
+  *mtime = info.st_mtime;
+  return (1);
+}
+
+char *Dot_Index_Path(GDB *gdb)
+{ char *path, *root, *cat;
+
+  path = PathTo(gdb->srcpath);
+  root = Root(gdb->srcpath,"");
+  cat  = Catenate(path,"/.",root,".dmi");
+  free(root);
+  free(path);
+  return (cat);
+}
+
+//  Return (in an allocated string) the path of the index of gdb in the GDB cache directory,
+//    or the temporary directory if there is none, used when the source's directory cannot
+//    be written.  The name includes a hash of the source path so that sources of the same
+//    name in different directories do not collide.
+
+static char *cache_index_path(GDB *gdb)
+{ char   *dir, *root, *cat;
+  char    suffix[30];
+  uint64  h;
+  int     i;
+
+  dir = Get_GDB_Cache();
+  if (dir == NULL)
+    dir = getenv("TMPDIR");
+  if (dir == NULL)
+    dir = "/tmp";
+
+  h = 0xcbf29ce484222325llu;
+  for (i = 0; gdb->srcpath[i] != '\0'; i++)
+    { h ^= (uint8) gdb->srcpath[i];
+      h *= 0x100000001b3llu;
+    }
+  sprintf(suffix,".%016llx.dmi",h);
+
+  root = Root(gdb->srcpath,"");
+  if (root == NULL)
+    return (NULL);
+  cat = Strdup(Catenate(dir,"/.",root,suffix),"Allocating index path");
+  free(root);
+  return (cat);
+}
+
+
+/*******************************************************************************************
+ *
+ *  INDEX CONSTRUCTION
+ *
+ ********************************************************************************************/
+
+typedef struct
+  { GDB             *gdb;
+    pthread_mutex_t *lock;
+    volatile int    *cancel;
+    volatile int64  *done;
+    int              cbeg, cend;                //  contigs [cbeg,cend) are done by this thread
+    int64            nmin[INDEX_NKMERS];
+    int64            nmax[INDEX_NKMERS];
+    int64           *spot[INDEX_NKMERS];
+    uint32          *code[INDEX_NKMERS];
+    int              error;
+  } Builder;
+
+  //  A bijective scramble of the k-mer codes so that minimizers are not biased to poly-A
+
+static inline uint64 scramble(uint64 x)
+{ x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdllu;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53llu;
+  x ^= x >> 33;
+  return (x);
+}
+
+static int add_minimizer(Builder *b, int i, int64 spot, uint32 code)
+{ int64 n = b->nmin[i];
+
+  if (n >= b->nmax[i])
+    { int64  m = 1.2*n + 1000;
+      void  *x;
+
+      x = realloc(b->spot[i],sizeof(int64)*m);
+      if (x == NULL)
+        return (1);
+      b->spot[i] = (int64 *) x;
+      x = realloc(b->code[i],sizeof(uint32)*m);
+      if (x == NULL)
+        return (1);
+      b->code[i] = (uint32 *) x;
+      b->nmax[i] = m;
+    }
+  b->spot[i][n] = spot;
+  b->code[i][n] = code;
+  b->nmin[i]    = n+1;
+  return (0);
+}
+
+  //  Add the minimizers of contig c, whose 2-bit sequence is in bytes, for the i'th k-mer size
+
+static int minimizers(Builder *b, int i, int c, uint8 *bytes)
+{ GDB_CONTIG *ctg   = b->gdb->contigs + c;
+  GDB_MASK   *masks = b->gdb->masks;
+  int         kmer  = IndexKmers[i];
+  int         w     = INDEX_WINDOW;
+
+  uint64  hash[INDEX_WINDOW];
+  uint32  kode[INDEX_WINDOW];
+  int64   spot[INDEX_WINDOW];
+
+  uint64  Kmask, Cumber[4];
+  uint64  u, f, x, h, minh;
+  int64   p, s, t, mins, last, lastm;
+  int64   r, e, clen;
+  int     km1, j;
+
+  clen = ctg->clen;
+  km1  = kmer-1;
+  if (clen < kmer)
+    return (0);
+
+  Kmask = (0x1llu << 2*kmer) - 1;
+  Cumber[0] = (0x3llu << 2*km1);
+  Cumber[1] = (0x2llu << 2*km1);
+  Cumber[2] = (0x1llu << 2*km1);
+  Cumber[3] = 0x0llu;
+
+  r = ctg->moff;
+  e = ctg[1].moff;
+
+  f = u = 0;
+  minh  = 0;
+  mins  = -1;
+  last  = -1;
+  lastm = -1;
+  for (p = 0; p < clen; p++)
+    { x = (bytes[p>>2] >> ((p&0x3)<<1)) & 0x3;
+      f = ((f << 2) | x) & Kmask;
+      u = (u >> 2) | Cumber[x];
+
+      while (r < e && masks[r].end <= p)
+        r += 1;
+      if (r < e && masks[r].beg <= p)
+        lastm = p;
+
+      if (p < km1)
+        continue;
+
+      s = p-km1;
+      j = s % w;
+      kode[j] = (uint32) (u < f ? u : f);
+      hash[j] = h = scramble(kode[j]);
+      spot[j] = ((ctg->sbeg + s) << 1) | (lastm >= s);
+
+      if (mins < s-(w-1))             //  minimum left the window, rescan it
+        { mins = s-(w-1);
+          minh = hash[mins%w];
+          for (t = mins+1; t <= s; t++)
+            if (hash[t%w] < minh)
+              { minh = hash[t%w];
+                mins = t;
+              }
+        }
+      else if (mins < 0 || h < minh)
+        { minh = h;
+          mins = s;
+        }
+
+      if (s >= w-1 && mins != last)
+        { if (add_minimizer(b,i,spot[mins%w],kode[mins%w]))
+            return (1);
+          last = mins;
+        }
+    }
+
+  //  A contig with fewer than w k-mers contributes its one minimizer
+
+  if (clen-km1 < w)
+    return (add_minimizer(b,i,spot[mins%w],kode[mins%w]));
+  return (0);
+}
+
+static pthread_mutex_t Progress = PTHREAD_MUTEX_INITIALIZER;   //  guards *done of all builders
+
+static void *build_thread(void *arg)
+{ Builder *b   = (Builder *) arg;
+  GDB     *gdb = b->gdb;
+  uint8   *buffer, *bytes;
+  int      c, i;
+
+  buffer = malloc(gdb->maxctg/4 + 2);
+  if (buffer == NULL)
+    { b->error = 1;
+      return (NULL);
+    }
+
+  for (c = b->cbeg; c < b->cend; c++)
+    { if (b->lock != NULL)
+        pthread_mutex_lock(b->lock);
+      if (gdb->seqstate == EXTERNAL)
+        bytes = Get_Contig_Bytes(gdb,c,0,gdb->contigs[c].clen,buffer);
+      else
+        bytes = Get_Contig_Bytes(gdb,c,0,gdb->contigs[c].clen,NULL);
+      if (b->lock != NULL)
+        pthread_mutex_unlock(b->lock);
+      if (bytes == NULL)
+        { b->error = 1;
+          break;
+        }
+      for (i = 0; i < INDEX_NKMERS; i++)
+        if (minimizers(b,i,c,bytes))
+          { b->error = 1;
+            break;
+          }
+      if (b->error)
+        break;
+
+      pthread_mutex_lock(&Progress);
+      *(b->done) += gdb->contigs[c].clen;
+      pthread_mutex_unlock(&Progress);
+      if (*(b->cancel))
+        break;
+    }
+
+  free(buffer);
+  return (NULL);
+}
+
+int Build_Dot_Index(GDB *gdb, pthread_mutex_t *lock, int nthreads,
+                    volatile int *cancel, volatile int64 *done)
+{ Builder   parm[nthreads];
+  pthread_t threads[nthreads];
+  int64     head[HEAD_FIX+5*INDEX_NKMERS];
+  int64     off, cum, n;
+  char     *path, *temp;
+  FILE     *out;
+  int       i, t, c, err;
+
+  if (gdb->seqs == NULL)
+    { EPRINTF(EPLACE,"%s: GDB has no sequence data (Build_Dot_Index)\n",Prog_Name);
+      EXIT(1);
+    }
+
+  //  Partition the contigs among the threads by sequence length
+
+  c = 0;
+  cum = 0;
+  for (t = 0; t < nthreads; t++)
+    { parm[t].gdb    = gdb;
+      parm[t].lock   = lock;
+      parm[t].cancel = cancel;
+      parm[t].done   = done;
+      parm[t].cbeg   = c;
+      while (c < gdb->ncontig && cum < (gdb->seqtot*(t+1))/nthreads)
+        cum += gdb->contigs[c++].clen;
+      if (t == nthreads-1)
+        c = gdb->ncontig;
+      parm[t].cend  = c;
+      parm[t].error = 0;
+      for (i = 0; i < INDEX_NKMERS; i++)
+        { parm[t].nmin[i] = parm[t].nmax[i] = 0;
+          parm[t].spot[i] = NULL;
+          parm[t].code[i] = NULL;
+        }
+    }
+
+  for (t = 1; t < nthreads; t++)
+    pthread_create(threads+t,NULL,build_thread,parm+t);
+  build_thread(parm);
+  for (t = 1; t < nthreads; t++)
+    pthread_join(threads[t],NULL);
+
+  err = 0;
+  for (t = 0; t < nthreads; t++)
+    err |= parm[t].error;
+  if (err)
+    { EPRINTF(EPLACE,"%s: Out of memory or read error building index (Build_Dot_Index)\n",
+                     Prog_Name);
+      goto error;
+    }
+  if (*cancel)
+    { EPRINTF(EPLACE,"%s: Index construction cancelled\n",Prog_Name);
+      goto error;
+    }
+
+  //  The threads did consecutive contigs, so concatenating their lists keeps them sorted
+
+  memset(head,0,sizeof(head));
+  strcpy((char *) head,MAGIC);
+  head[1] = gdb->seqtot;
+  head[2] = gdb->ncontig;
+  head[3] = INDEX_NKMERS;
+  if ( ! source_stamp(gdb,head+4,head+5))
+    { EPRINTF(EPLACE,"%s: Cannot stat source file %s\n",Prog_Name,gdb->srcpath);
+      goto error;
+    }
+  off = sizeof(head);
+  for (i = 0; i < INDEX_NKMERS; i++)
+    { n = 0;
+      for (t = 0; t < nthreads; t++)
+        n += parm[t].nmin[i];
+      head[HEAD_FIX+5*i]   = IndexKmers[i];
+      head[HEAD_FIX+5*i+1] = INDEX_WINDOW;
+      head[HEAD_FIX+5*i+2] = n;
+      head[HEAD_FIX+5*i+3] = off;
+      off += sizeof(int64)*n;
+      head[HEAD_FIX+5*i+4] = off;
+      off += sizeof(uint32)*n;
+      off  = (off+7) & ~0x7ll;
+    }
+
+  path = Strdup(Dot_Index_Path(gdb),"Allocating index path");
+  temp = Strdup(Catenate(path,"","",".tmp"),"Allocating index path");
+  if (path == NULL || temp == NULL)
+    { free(path);
+      EPRINTF(EPLACE,"%s: Out of memory (Build_Dot_Index)\n",Prog_Name);
+      goto error;
+    }
+
+  out = fopen(temp,"w");
+  if (out == NULL)                    //  source directory not writable: use the cache
+    { free(temp);
+      free(path);
+      path = cache_index_path(gdb);
+      temp = NULL;
+      if (path != NULL)
+        temp = Strdup(Catenate(path,"","",".tmp"),"Allocating index path");
+      if (temp != NULL)
+        out = fopen(temp,"w");
+      if (out == NULL)
+        { EPRINTF(EPLACE,"%s: Cannot create index file %s\n",Prog_Name,
+                         temp != NULL ? temp : Dot_Index_Path(gdb));
+          free(temp);
+          free(path);
+          goto error;
+        }
+    }
+
+  err = (fwrite(head,sizeof(head),1,out) != 1);
+  for (i = 0; i < INDEX_NKMERS && ! err; i++)
+    { for (t = 0; t < nthreads; t++)
+        if (parm[t].nmin[i] > 0)
+          err |= (fwrite(parm[t].spot[i],sizeof(int64)*parm[t].nmin[i],1,out) != 1);
+      for (t = 0; t < nthreads; t++)
+        if (parm[t].nmin[i] > 0)
+          err |= (fwrite(parm[t].code[i],sizeof(uint32)*parm[t].nmin[i],1,out) != 1);
+      if (i < INDEX_NKMERS-1 && ftello(out) < head[HEAD_FIX+5*(i+1)+3])
+        { int64 zero = 0;
+          err |= (fwrite(&zero,head[HEAD_FIX+5*(i+1)+3]-ftello(out),1,out) != 1);
+        }
+    }
+  err |= (fclose(out) != 0);
+
+  if (err || rename(temp,path) != 0)
+    { EPRINTF(EPLACE,"%s: Could not write index file %s\n",Prog_Name,path);
+      unlink(temp);
+      free(temp);
+      free(path);
+      goto error;
+    }
+
+  free(temp);
+  free(path);
+  for (t = 0; t < nthreads; t++)
+    for (i = 0; i < INDEX_NKMERS; i++)
+      { free(parm[t].spot[i]);
+        free(parm[t].code[i]);
+      }
+  return (0);
+
+error:
+  for (t = 0; t < nthreads; t++)
+    for (i = 0; i < INDEX_NKMERS; i++)
+      { free(parm[t].spot[i]);
+        free(parm[t].code[i]);
+      }
+  EXIT(1);
+}
+
+
+/*******************************************************************************************
+ *
+ *  INDEX ACCESS
+ *
+ ********************************************************************************************/
+
+//  Map the index at path if it is one for gdb whose source has the given size and mtime
+
+static DotIndex *map_index(GDB *gdb, char *path, int64 size, int64 mtime)
+{ DotIndex   *index;
+  struct stat info;
+  int64      *head;
+  void       *map;
+  int         fd, i;
+
+  fd = open(path,O_RDONLY);
+  if (fd < 0)
+    return (NULL);
+  if (fstat(fd,&info) < 0 || info.st_size < (off_t) (sizeof(int64)*(HEAD_FIX+5*INDEX_NKMERS)))
+    { close(fd);
+      return (NULL);
+    }
+  map = mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return (NULL);
+
+  head = (int64 *) map;
+  if (strcmp((char *) head,MAGIC) != 0 || head[1] != gdb->seqtot || head[2] != gdb->ncontig
+                                       || head[3] != INDEX_NKMERS
+                                       || head[4] != size || head[5] != mtime)
+    { munmap(map,info.st_size);
+      return (NULL);
+    }
+
+  index = malloc(sizeof(DotIndex));
+  if (index == NULL)
+    { munmap(map,info.st_size);
+      return (NULL);
+    }
+  index->nk   = INDEX_NKMERS;
+  index->map  = map;
+  index->size = info.st_size;
+  for (i = 0; i < INDEX_NKMERS; i++)
+    { DotIndexK *ik = index->ks+i;
+      int64     *h  = head + (HEAD_FIX+5*i);
+
+      ik->kmer   = h[0];
+      ik->window = h[1];
+      ik->nmin   = h[2];
+      ik->spot   = (int64 *) (((char *) map) + h[3]);
+      ik->code   = (uint32 *) (((char *) map) + h[4]);
+      if (h[4] + ((int64) sizeof(uint32))*h[2] > index->size)
+        { munmap(map,info.st_size);
+          free(index);
+          return (NULL);
+        }
+    }
+  return (index);
+}
+
+DotIndex *Open_Dot_Index(GDB *gdb)
+{ DotIndex *index;
+  int64     size, mtime;
+  char     *path;
+
+  if ( ! source_stamp(gdb,&size,&mtime))
+    return (NULL);
+
+  index = map_index(gdb,Dot_Index_Path(gdb),size,mtime);
+  if (index == NULL)
+    { path = cache_index_path(gdb);
+      if (path != NULL)
+        index = map_index(gdb,path,size,mtime);
+      free(path);
+    }
+  return (index);
+}
+
+void Close_Dot_Index(DotIndex *index)
+{ if (index == NULL)
+    return;
+  munmap(index->map,index->size);
+  free(index);
+}
+
+DotIndexK *Dot_Index_Kmer(DotIndex *index, int kmer)
+{ int i;
+
+  if (index == NULL)
+    return (NULL);
+  for (i = 0; i < index->nk; i++)
+    if (index->ks[i].kmer == kmer)
+      return (index->ks+i);
+  return (NULL);
+}
+
+static int64 lower_spot(DotIndexK *ik, int64 spot)
+{ int64 l, r, m;
+
+  l = 0;
+  r = ik->nmin;
+  while (l < r)
+    { m = (l+r)/2;
+      if (ik->spot[m] < spot)
+        l = m+1;
+      else
+        r = m;
+    }
+  return (l);
+}
+
+void Dot_Index_Range(DotIndexK *ik, int64 vbeg, int64 vend, int64 *beg, int64 *end)
+{ *beg = lower_spot(ik,vbeg<<1);
+  *end = lower_spot(ik,vend<<1);
+}
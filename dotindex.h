@@ -0,0 +1,70 @@
+/*****************************************************************************************\
+*                                                                                         *
+*  Minimizer index of a GDB for the k-mer dot plot layer                                  *
+*                                                                                         *
+*  For each of a few k, the (w,k)-minimizers of every contig are recorded in order of     *
+*  global position so that the minimizers in any view can be found by binary search and   *
+*  joined without decoding or sorting any sequence.  The index is built once, saved next  *
+*  to the GDB's source, and memory mapped whenever the GDB is opened thereafter.          *
+*                                                                                         *
+\*****************************************************************************************/
+
+#ifndef _DOT_INDEX
+#define _DOT_INDEX
+
+#include <pthread.h>
+
+#include "gene_core.h"
+#include "GDB.h"
+
+#define INDEX_NKMERS  3      //  # of k-mer sizes indexed
+#define INDEX_WINDOW 16      //  # of consecutive k-mers in a minimizer window
+
+extern int IndexKmers[INDEX_NKMERS];   //  the k-mer sizes indexed (all <= 16)
+
+typedef struct
+  { int     kmer;     //  k-mer size
+    int     window;   //  minimizer window
+    int64   nmin;     //  # of minimizers
+    int64  *spot;     //  spot[i] = (global position of minimizer i)<<1 | (1 if it overlaps a soft mask)
+    uint32 *code;     //  code[i] = canonical 2-bit code of minimizer i
+  } DotIndexK;
+
+typedef struct
+  { int        nk;
+    DotIndexK  ks[INDEX_NKMERS];
+    void      *map;     //  memory mapped index file
+    int64      size;    //  size of the mapping in bytes
+  } DotIndex;
+
+  //  Return the path of the index file for gdb in a temporary buffer.  If the directory of
+  //    gdb's source cannot be written, the index is instead kept in the GDB cache directory
+  //    (see Set_GDB_Cache), or the temporary directory if none is set, and found there too.
+
+char *Dot_Index_Path(GDB *gdb);
+
+  //  Build the index for gdb whose contig sbeg's have been converted to global coordinates,
+  //    using nthreads threads, and write it to its index file.  lock, if not NULL, guards the
+  //    sequence reads of gdb.  The bases of each contig are added to *done as it is indexed,
+  //    and if *cancel becomes non-zero the build is abandoned without writing any file.
+  //    Returns 0 on success and 1 with a message at EPLACE otherwise.
+
+int Build_Dot_Index(GDB *gdb, pthread_mutex_t *lock, int nthreads,
+                    volatile int *cancel, volatile int64 *done);
+
+  //  Memory map the index file of gdb if there is one for it that was built from its current
+  //    source file, otherwise return NULL
+
+DotIndex *Open_Dot_Index(GDB *gdb);
+
+void Close_Dot_Index(DotIndex *index);
+
+  //  Return the part of index for k-mers of size kmer, or NULL if there is none
+
+DotIndexK *Dot_Index_Kmer(DotIndex *index, int kmer);
+
+  //  Set [*beg,*end) to the range of minimizers of ik starting in [vbeg,vend)
+
+void Dot_Index_Range(DotIndexK *ik, int64 vbeg, int64 vend, int64 *beg, int64 *end);
+
+#endif // _DOT_INDEX
@@ -354,6 +354,76 @@ void Uncompress_Read(int len, char *s)
   s[len] = 4;
 }
 
+//  Uncompress bases [beg,beg+len) of the 2-bit string t into s, 8 bases at a time.  Each
+//    group of 8 is fetched as a 16-bit window of t and its 2-bit fields are spread to the 8
+//    bytes of a 64-bit word with 3 shift-and-mask steps.  If letter is not zero the numbers
+//    are then converted in the same word to letters starting at letter ('A' or 'a'):
+//    A,C,G,T are at offsets 0,2,6,19 = 2*b0 + 6*b1 + 11*(b0&b1) where b1b0 is the base.
+//    The groups are done from last to first so that s may be t if beg < 4.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SWAR_DECODE 0
+#else
+#define SWAR_DECODE 1
+#endif
+
+static void decode_range(uint8 *t, int beg, int len, char *s, int letter)
+{ static char lower[4] = { 'a', 'c', 'g', 't' };
+  static char upper[4] = { 'A', 'C', 'G', 'T' };
+  char  *let;
+  int    k, j, q, sh;
+
+  if (letter == 'a')
+    let = lower;
+  else
+    let = upper;
+
+  //  Bases beyond the last whole group, one at a time
+
+  j = (SWAR_DECODE ? (len & ~0x7) : 0);
+  for (k = len-1; k >= j; k--)
+    { q = (k+beg) >> 2;
+      s[k] = (char) ((t[q] >> (((k+beg)&0x3) << 1)) & 0x3);
+      if (letter)
+        s[k] = let[(int) s[k]];
+    }
+
+#if SWAR_DECODE
+  { uint64 x, b0, b1;
+
+    sh = (beg & 0x3) << 1;
+    for (k = j-8; k >= 0; k -= 8)
+      { q = (k+beg) >> 2;
+        if (sh == 0)
+          x = t[q] | (t[q+1] << 8);
+        else
+          x = ((t[q] | (t[q+1] << 8) | (t[q+2] << 16)) >> sh) & 0xffff;
+        x = (x | (x << 24)) & 0x000000ff000000ffllu;
+        x = (x | (x << 12)) & 0x000f000f000f000fllu;
+        x = (x | (x <<  6)) & 0x0303030303030303llu;
+        if (letter)
+          { b0 = x & 0x0101010101010101llu;
+            b1 = (x >> 1) & 0x0101010101010101llu;
+            x  = (b0 << 1) + b1*6 + (b0 & b1)*11 + letter*0x0101010101010101llu;
+          }
+        memcpy(s+k,&x,8);
+      }
+  }
+#else
+  (void) sh;
+#endif
+}
+
+void Uncompress_Range(char *t, int beg, int len, char *s)
+{ decode_range((uint8 *) t,beg,len,s,0);
+  s[len] = 4;
+}
+
+void Letter_Range(char *t, int beg, int len, char *s, int upper)
+{ decode_range((uint8 *) t,beg,len,s,upper ? 'A' : 'a');
+  s[len] = '\0';
+}
+
 //  Convert read in [0-3] representation to ascii representation (end with '\n')
 
 void Lower_Read(char *s)
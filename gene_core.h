@@ -157,6 +157,13 @@ int  Number_Digits(int64 num);                            //  Return # of digits
 
 void   Compress_Read(int len, char *s);   //  Compress read in-place into 2-bit form
 void Uncompress_Read(int len, char *s);   //  Uncompress read in-place into numeric form
+
+  //  Uncompress bases [beg,beg+len) of the 2-bit string t into s in numeric form (ending
+  //    with 4) or in upper or lower case letters (ending with '\0').  s may be t if beg < 4.
+
+void Uncompress_Range(char *t, int beg, int len, char *s);
+void     Letter_Range(char *t, int beg, int len, char *s, int upper);
+
 void      Print_Read(char *s, int width);
 
 void Lower_Read(char *s);     //  Convert read from numbers to lowercase letters (0-3 to acgt)
@@ -10,6 +10,7 @@ extern "C" {
 #include "sticks.h"
 #include "doter.h"
 #include "select.h"
+#include "raster.h"
 }
 
 #undef DEBUG
@@ -23,6 +24,24 @@ extern "C" {
 
 #define LOCATOR_RECTANGLE_SIZE 100
 
+#define NUM_DOT_CAPS 5
+
+#define TILE_SIZE         256
+#define TILE_MARGIN       4                 //  pixels beyond a tile whose segments touch it
+#define TILE_LEVELS       0x10000000000ll   //  scales within a factor 2^(1/this) share tiles
+#define TILE_CACHE_MEMORY 0x4000000         //  Least memory cap of each canvas' tile cache (64MB)
+#define TILE_FRAMES       4                 //  tile cache holds at least this many full views
+
+#define RASTER_MIN        512   //  tiles with at least this many segments are rasterized by
+                                //    several threads
+#define HEAT_PIXELS         2   //  a layer whose lines would cross 1 in this many pixels of
+                                //    the plot area is drawn as a heat map
+#define HEAT_DEPTH          8   //  a heat map pixel is opaque at this many alignments deep
+
+static int DotCaps[NUM_DOT_CAPS] = { 0, 10, 100, 1000, 10000 };  //  k-mer occurrence caps
+
+static bool Indexing = false;   //  dot plot indices are being built, start no dot plot job
+
 QRect *DotWindow::screenGeometry = NULL;
 int    DotWindow::windowWidth;
 int    DotWindow::windowHeight;
@@ -115,6 +134,79 @@ void MyMenu::keyReleaseEvent(QKeyEvent *ev)
 { QCoreApplication::sendEvent(parent(),ev); }
 
 
+/***************************************************************************************/
+/*                                                                                     */
+/*   DOT PLOT WORKER                                                                   */
+/*                                                                                     */
+/***************************************************************************************/
+
+//  A DotJob computes the k-mer dot plot image for a given view off the GUI thread.  Each
+//    job has its own dotplot working memory so a cancelled job can finish in the background
+//    while its successor runs.
+
+DotJob::DotJob(DotPlot *p, View *v, int k, int cp, bool m, int w, int h, QColor c) : QThread()
+{ plot  = p;
+  view  = *v;
+  kmer  = k;
+  cap   = cp;
+  mask  = m;
+  rectW = w;
+  rectH = h;
+  color = c;
+  image = NULL;
+  halt  = 0;
+  xa    = (rectW-44.)/view.w;
+  ya    = (rectH-44.)/view.h;
+}
+
+DotJob::~DotJob()
+{ delete image; }
+
+bool DotJob::sameAs(View *v, int k, int cp, bool m, int w, int h, QColor c)
+{ return (view.x == v->x && view.y == v->y && view.w == v->w && view.h == v->h &&
+          kmer == k && cap == cp && mask == m && rectW == w && rectH == h && color == c);
+}
+
+void DotJob::cancel()
+{ halt = 1; }
+
+void DotJob::run()
+{ QVector<QRgb> ctable(256);
+  void  *memory;
+  int    i, r, g, b;
+  double f;
+
+  memory = dotplot_memory();
+  if (memory == NULL)
+    return;
+
+  //  Hit counts index a color table that shades from dim to the full layer color
+
+  r = color.red();
+  g = color.green();
+  b = color.blue();
+  ctable[0] = qRgb(0,0,0);
+  for (i = 1; i < 256; i++)
+    { f = .4 + .6*log(i)/log(255.);
+      ctable[i] = qRgb((int) (f*r),(int) (f*g),(int) (f*b));
+    }
+
+  image = new QImage(rectW,rectH,QImage::Format_Indexed8);
+  image->setColorTable(ctable);
+  image->fill(0);
+
+  i = dotraster(plot,memory,kmer,cap,mask,&view,QThread::idealThreadCount(),
+                rectW,rectH,image->bits(),image->bytesPerLine(),&counts,&halt);
+
+  free(memory);
+
+  if (i < 0 || halt)
+    { delete image;
+      image = NULL;
+    }
+}
+
+
 /***************************************************************************************/
 /*                                                                                     */
 /*   DOT CANVAS                                                                        */
@@ -122,7 +214,47 @@ void MyMenu::keyReleaseEvent(QKeyEvent *ev)
 /***************************************************************************************/
 
 DotCanvas::~DotCanvas()
-{ }
+{ cancelDots(); }
+
+//  Stop all dot plot jobs and the sequence read-ahead and wait for them to finish, and
+//    discard the image shown so that the next paint recomputes it.  Must be called before
+//    the plot the jobs refer to is freed or its dot plot index is changed.
+
+void DotCanvas::cancelDots()
+{ int i;
+
+  for (i = 0; i < dotJobs.length(); i++)
+    dotJobs[i]->cancel();
+  for (i = 0; i < dotJobs.length(); i++)
+    { dotJobs[i]->wait();
+      delete dotJobs[i];
+    }
+  dotJobs.clear();
+  dotPending = NULL;
+  delete dotShown;
+  dotShown = NULL;
+  Free_Prefetcher(prefetch);
+  prefetch   = NULL;
+  noPrefetch = false;
+}
+
+void DotCanvas::dotsDone()
+{ DotJob *job = (DotJob *) sender();
+
+  if ( ! dotJobs.removeOne(job))     //  already reaped by cancelDots
+    return;
+  job->wait();
+  if (job == dotPending)
+    { dotPending = NULL;
+      if (job->image != NULL)
+        { delete dotShown;
+          dotShown = job;
+          update();
+          return;
+        }
+    }
+  job->deleteLater();
+}
 
 DotCanvas::DotCanvas(QWidget *parent) : QWidget(parent)
 { setSizePolicy(QSizePolicy::MinimumExpanding,QSizePolicy::MinimumExpanding);
@@ -131,8 +263,12 @@ DotCanvas::DotCanvas(QWidget *parent) : QWidget(parent)
   rubber  = new QRubberBand(QRubberBand::Rectangle, this);
   timer   = new QBasicTimer();
 
-  image  = NULL;
-  raster = new uchar *[screen()->availableGeometry().height()];
+  dotShown   = NULL;
+  dotPending = NULL;
+  prefetch   = NULL;
+  noPrefetch = false;
+  traceReads = 0;
+  tiles.setMaxCost(TILE_CACHE_MEMORY);
 
   setAttribute(Qt::WA_KeyCompression,false);
 
@@ -472,6 +608,16 @@ void DotCanvas::keyReleaseEvent(QKeyEvent *event)
 #endif
 }
 
+//  Global start of the i'th scaffold of db, or of the i'th contig if contigs is set
+
+static inline int64 startOf(DotGDB *db, bool contigs, int i)
+{ GDB_CONTIG *ctg = db->gdb.contigs;
+
+  if (contigs)
+    return (ctg[i].sbeg);
+  return (ctg[db->gdb.scaffolds[i].fctg].sbeg);
+}
+
 DotSegment *DotCanvas::pick(int ex, int ey, DotLayer **pickedLayer)
 { QuadLeaf   *list;
   int         j, k;
@@ -599,7 +745,8 @@ void DotCanvas::mousePressEvent(QMouseEvent *event)
         goto pick_code;
       }
     else
-      { select = true;
+      { select    = true;
+        exporting = (lastKey == Qt::Key_E);
         rubber->setGeometry(QRect(mouseX,mouseY,0,0));
         rubber->show();
         QApplication::changeOverrideCursor(Qt::CrossCursor);
@@ -627,9 +774,9 @@ pick_code:
       double d1, d2;
       int    len, prec;
 
-      s1 = Map_Coord(&(plot->db1->gdb),pickedSeg->abeg,-1,
+      s1 = Map_Coord(plot->db1,pickedSeg->abeg,-1,
                      state->format,state->view.w);
-      s2 = Map_Coord(&(plot->db2->gdb),-1,pickedSeg->bbeg,
+      s2 = Map_Coord(plot->db2,-1,pickedSeg->bbeg,
                      state->format,state->view.h);
       aline->setText(tr("Beg: %1,%2").arg(s1).arg(s2));
 
@@ -642,6 +789,20 @@ pick_code:
       bline->setText(tr("Len: %1%2   Id: %3\%").
                         arg(len/d1,4,'f',prec).arg(s1).arg(pickedSeg->iid));
 
+      { Frame region;
+        int   sa, sb;
+
+        sa = Coord_Scaffold(plot->db1->coords,pickedSeg->abeg);
+        sb = Coord_Scaffold(plot->db2->coords,
+                            pickedSeg->bbeg < pickedSeg->bend ? pickedSeg->bbeg : pickedSeg->bend);
+        region.x = startOf(plot->db1,false,sa);
+        region.y = startOf(plot->db2,false,sb);
+        region.w = plot->db1->gdb.scaffolds[sa].slen;
+        region.h = plot->db2->gdb.scaffolds[sb].slen;
+        ((DotWindow *) parent())->showStats(&region,pickedLayer,
+                                            tr("Scaffolds %1 x %2").arg(sa+1).arg(sb+1));
+      }
+
       popup->popup(event->globalPosition().toPoint());
 
       return;
@@ -649,11 +810,40 @@ pick_code:
   menuLock = false;
 }
 
+//  Set region to the part of the current frame selected by the rubber band, returning
+//    false if it is empty
+
+bool DotCanvas::selectedRegion(Frame *region)
+{ QRect reg = rubber->geometry();
+  int64 xb = frame.x + ((reg.x()-20.)/(rectW-40.))*frame.w;
+  int64 yb = frame.y + ((reg.y()-20.)/(rectH-40.))*frame.h;
+  int64 xe = frame.x + (((reg.x()-20.)+reg.width())/(rectW-40.))*frame.w;
+  int64 ye = frame.y + (((reg.y()-20.)+reg.height())/(rectH-40.))*frame.h;
+  if (xb < 0) xb = 0;
+  if (xb < frame.x) xb = frame.x;
+  if (yb < 0) yb = 0;
+  if (yb < frame.y) yb = frame.y;
+  if (xe > plot->alen) xe = plot->alen;
+  if (xe > frame.x+frame.w) xe = frame.x+frame.w;
+  if (ye > plot->blen) ye = plot->blen;
+  if (ye > frame.y+frame.h) ye = frame.y+frame.h;
+  region->x = xb;
+  region->y = yb;
+  region->w = xe-xb;
+  region->h = ye-yb;
+  return (xe > xb && ye > yb);
+}
+
 void DotCanvas::mouseMoveEvent(QMouseEvent *event)
 { xpos = event->position().toPoint().x();
   ypos = event->position().toPoint().y();
   if (select)
-    rubber->setGeometry(QRect(mouseX,mouseY,xpos-mouseX,ypos-mouseY).normalized());
+    { Frame region;
+
+      rubber->setGeometry(QRect(mouseX,mouseY,xpos-mouseX,ypos-mouseY).normalized());
+      if (selectedRegion(&region))
+        ((DotWindow *) parent())->showStats(&region,NULL,tr("Selection"));
+    }
   else if (!picking)
     { if (nograb)
         { if (abs(xpos-mouseX) <= 1 && abs(ypos-mouseY) <= 1)
@@ -689,27 +879,20 @@ void DotCanvas::mouseReleaseEvent(QMouseEvent *event)
 #ifdef DEBUG
       printf("Selected\n");
 #endif
-      QRect reg  = rubber->geometry();
+      Frame region;
       View  undo = state->view;
-      int64 xb = frame.x + ((reg.x()-20.)/(rectW-40.))*frame.w;
-      int64 yb = frame.y + ((reg.y()-20.)/(rectH-40.))*frame.h;
-      int64 xe = frame.x + (((reg.x()-20.)+reg.width())/(rectW-40.))*frame.w;
-      int64 ye = frame.y + (((reg.y()-20.)+reg.height())/(rectH-40.))*frame.h;
-      if (xb < 0) xb = 0;
-      if (xb < frame.x) xb = frame.x;
-      if (yb < 0) yb = 0;
-      if (yb < frame.y) yb = frame.y;
-      if (xe > plot->alen) xe = plot->alen;
-      if (xe > frame.x+frame.w) xe = frame.x+frame.w;
-      if (ye > plot->blen) ye = plot->blen;
-      if (ye > frame.y+frame.h) ye = frame.y+frame.h;
-      state->view.x = xb;
-      state->view.y = yb;
-      state->view.w = xe-xb;
-      state->view.h = ye-yb;
+      bool  some = selectedRegion(&region);
+      if (exporting)
+        { if (some)
+            ((DotWindow *) parent())->exportRegion(&region);
+          return;
+        }
+      state->view.x = region.x;
+      state->view.y = region.y;
+      state->view.w = region.w;
+      state->view.h = region.h;
 #ifdef DEBUG
-      printf("Region select (%d,%d) %d x %d\n",reg.x(),reg.y(),reg.width(),reg.height());
-      printf("      = view  (%lld,%lld) (%lld,%lld)\n",xb,yb,xe,ye);
+      printf("Region select (%.0f,%.0f) %.0f x %.0f\n",region.x,region.y,region.w,region.h);
 #endif
       if (viewToFrame())
         update();
@@ -752,22 +935,393 @@ void DotCanvas::mouseReleaseEvent(QMouseEvent *event)
 void DotCanvas::showAlign()
 { DotWindow   *par;
   AlignWindow *awin;
-  char        *title, *align;
+  AlignJob    *job;
 
-  align = create_alignment(plot,pickedLayer,pickedSeg,&title);
+  job = New_Align_Job(plot,pickedLayer,pickedSeg);
 
   par = (DotWindow *) parent();
 
-  awin = new AlignWindow(tr(title),align,par,Qt::Tool);
+  if (job == NULL)
+    { DotWindow::warning(tr(EPLACE),par,DotWindow::ERROR,tr("OK"));
+      return;
+    }
+
+  awin = new AlignWindow(job,par,Qt::Tool);
   awin->show();
   awin->move(QPoint(state->wGeom.x()+DotWindow::windowHeight,state->wGeom.y()));
   awin->raise();
 
-  // par->addTextBox(awin);
+  par->addTextBox(awin);
 }
  
-QVector<QRgb>  DotCanvas::ctable(2);
-QVector<uchar> DotCanvas::imbit(8);
+//  Return the last scaffold (contig if contigs is set) s in [1,n) of db whose start, at
+//    scale a and offset b, is at pixel <= lim, or 0 if there is none.  The coordinate index
+//    gives a candidate that is then adjusted by at most a step or two to where the pixel
+//    test changes.
+
+static int lastBoundary(DotGDB *db, bool contigs, int n, double a, double b, int lim)
+{ double t;
+  int    s;
+
+  if (n <= 1)
+    return (0);
+  t = (lim+1-b)/a;
+  if (t < 0.)
+    s = 0;
+  else if (t >= startOf(db,contigs,n-1))
+    s = n-1;
+  else if (contigs)
+    s = Coord_Contig(db->coords,(int64) t);
+  else
+    s = Coord_Scaffold(db->coords,(int64) t);
+  if (s < 0)
+    s = 0;
+  while (s+1 < n && startOf(db,contigs,s+1)*a+b < lim+1)
+    s += 1;
+  while (s >= 1 && startOf(db,contigs,s)*a+b >= lim+1)
+    s -= 1;
+  return (s);
+}
+
+//  Draw the boundaries lf+1..rt of db (scaffold starts, or contig starts other than those
+//    of a scaffold if contigs is set), which lie in pixels [plo,phi] at scale a and offset b,
+//    as lines across [clo,chi] in the current pen, vertical if vert is set.  If there are
+//    more boundaries than pixels then instead shade the band of every pixel line holding a
+//    boundary by how many it holds, visiting only the boundaries at the ends of each line.
+
+static int BandShade[5] = { 0, 48, 80, 112, 144 };
+
+static void drawBoundaries(QPainter &painter, DotGDB *db, bool contigs, int n, double a, double b,
+                           int lf, int rt, int plo, int phi, bool vert, int clo, int chi)
+{ GDB_CONTIG   *ctg = db->gdb.contigs;
+  GDB_SCAFFOLD *scf = db->gdb.scaffolds;
+  int           i, p, k, q;
+  int           lev, plev, pbeg;
+
+  if (rt-lf <= (phi-plo)+1)
+    { for (i = lf+1; i <= rt; i++)
+        { if (contigs && scf[ctg[i].scaf].fctg == i)
+            continue;
+          p = (int) (startOf(db,contigs,i)*a+b);
+          if (vert)
+            painter.drawLine(p,clo,p,chi);
+          else
+            painter.drawLine(clo,p,chi,p);
+        }
+      return;
+    }
+
+  QColor shade = painter.pen().color();
+
+  q    = lf;
+  plev = 0;
+  pbeg = plo;
+  for (p = plo; p <= phi+1; p++)
+    { if (p <= phi)
+        { k = lastBoundary(db,contigs,n,a,b,p);
+          if (k == q)
+            lev = 0;
+          else if (k-q == 1)
+            lev = 1;
+          else if (k-q < 4)
+            lev = 2;
+          else if (k-q < 16)
+            lev = 3;
+          else
+            lev = 4;
+          q = k;
+        }
+      else
+        lev = -1;
+      if (lev != plev)
+        { if (plev > 0)
+            { shade.setAlpha(BandShade[plev]);
+              if (vert)
+                painter.fillRect(pbeg,clo,p-pbeg,(chi-clo)+1,shade);
+              else
+                painter.fillRect(clo,pbeg,(chi-clo)+1,p-pbeg,shade);
+            }
+          plev = lev;
+          pbeg = p;
+        }
+    }
+}
+
+  //  Local identity display: a segment at least ID_MIN_PIXELS long on screen is drawn
+  //    through its trace points, consecutive intervals being merged until at least ID_PIXELS
+  //    long, each piece colored from red at ID_FLOOR% identity or less to green at 100%.
+  //    The traces are read from the .1aln file on the GUI thread, so a paint reads at most
+  //    ID_READS of them, drawing the other segments plainly until a later paint (see
+  //    layerTile).
+
+#define ID_MIN_PIXELS 16
+#define ID_PIXELS      2
+#define ID_FLOOR      70.
+#define ID_READS     100
+
+static bool drawIdentity(QPainter &painter, QPen pen, DotLayer *layer, DotSegment *seg,
+                         double xa, double xb, double ya, double yb, int *reads)
+{ SegTrace *t;
+  double    x0, y0, x1, y1, iid;
+  int64     alen, diffs;
+  int       i;
+
+  t = Segment_Trace(layer,seg,reads);
+  if (t == NULL)
+    return (false);
+
+  x0 = t->apos[0]*xa+xb;
+  y0 = t->bpos[0]*ya+yb;
+  alen  = 0;
+  diffs = 0;
+  for (i = 0; i < t->npts; i++)
+    { alen  += t->apos[i+1] - t->apos[i];
+      diffs += t->diffs[i];
+      x1 = t->apos[i+1]*xa+xb;
+      y1 = t->bpos[i+1]*ya+yb;
+      if (i < t->npts-1 && fabs(x1-x0) < ID_PIXELS && fabs(y1-y0) < ID_PIXELS)
+        continue;
+      iid = 100. - (100.*diffs)/(alen > 0 ? alen : 1);
+      if (iid < ID_FLOOR)
+        iid = ID_FLOOR;
+      pen.setColor(QColor::fromHsv((int) (120.*(iid-ID_FLOOR)/(100.-ID_FLOOR)),255,255));
+      painter.setPen(pen);
+      painter.drawLine(QLineF(x0,y0,x1,y1));
+      x0 = x1;
+      y0 = y1;
+      alen  = 0;
+      diffs = 0;
+    }
+  return (true);
+}
+
+//  The forward and reverse pens of alignment layer k
+
+void DotCanvas::layerPens(int k, QPen *fPen, QPen *rPen)
+{ static int   Thickint[5] = { 0, 1, 0, 2, 3 };
+  static qreal Thickreal[5] = { .5, 0, 1.5, 0, 0 };
+  int i;
+
+  fPen->setColor(state->colorF[k]);
+  rPen->setColor(state->colorR[k]);
+  i = state->thick[k];
+  if (i == 0 || i == 2)
+    { fPen->setWidthF(Thickreal[i]);
+      rPen->setWidthF(Thickreal[i]);
+    }
+  else
+    { fPen->setWidth(Thickint[i]);
+      rPen->setWidth(Thickint[i]);
+    }
+}
+
+//  Draw segment line of layer k at scales xa, ya and offsets xb, yb
+
+void DotCanvas::drawSegment(QPainter &painter, int k, DotSegment *line, QPen &fPen, QPen &rPen,
+                            double xa, double xb, double ya, double yb)
+{ int xbeg, xend;
+  int ybeg, yend;
+
+  xbeg = (int) (line->abeg*xa+xb);
+  ybeg = (int) (line->bbeg*ya+yb);
+  xend = (int) (line->aend*xa+xb);
+  yend = (int) (line->bend*ya+yb);
+  if (state->idViz && (abs(xend-xbeg) >= ID_MIN_PIXELS || abs(yend-ybeg) >= ID_MIN_PIXELS))
+    if (drawIdentity(painter,fPen,plot->layers[k],line,xa,xb,ya,yb,&traceReads))
+      return;
+  if (line->bbeg < line->bend)
+    painter.setPen(fPen);
+  else
+    painter.setPen(rPen);
+  painter.drawLine(xbeg,ybeg,xend,yend);
+}
+
+//  Line layers are rendered into TILE_SIZE x TILE_SIZE images, tile (i,j) of a scale covering
+//    the global pixels [i*TILE_SIZE,(i+1)*TILE_SIZE) x [j*TILE_SIZE,(j+1)*TILE_SIZE) where
+//    the global pixel of coordinate a is a*xa.  A tile is keyed by its layer, scale, and
+//    drawing style, and the last tiles used are kept up to TILE_FRAMES views' worth of all
+//    visible layers (but no less than TILE_CACHE_MEMORY bytes), so that panning and
+//    returning to an earlier zoom only render the tiles never seen.  A tile is rendered at
+//    the device pixel ratio of the canvas (so it is sharp on a high density display), and
+//    blitted at the nearest whole pixel so its lines may be up to half a pixel off.
+
+bool operator==(const TileKey &a, const TileKey &b)
+{ return (a.layer == b.layer && a.xlev == b.xlev && a.ylev == b.ylev && a.i == b.i && a.j == b.j
+           && a.colorF == b.colorF && a.colorR == b.colorR && a.thick == b.thick
+           && a.idViz == b.idViz && a.heat == b.heat && a.dpr == b.dpr);
+}
+
+size_t qHash(const TileKey &key, size_t seed)
+{ return (qHash((quint64) (key.i*0x9e3779b97f4a7c15ll ^ key.j*0xc2b2ae3d27d4eb4fll
+                           ^ key.xlev ^ (key.ylev << 17) ^ (key.thick << 3) ^ key.idViz
+                           ^ (key.heat << 1) ^ ((quint64) key.dpr << 48)
+                           ^ key.colorF ^ ((quint64) key.colorR << 32)
+                           ^ (quint64) key.layer),seed));
+}
+
+QImage *DotCanvas::layerTile(int k, int64 i, int64 j, double xa, double ya, bool heat)
+{ TileKey  key;
+  QImage  *tile;
+  qreal    dpr;
+  int      dsize;
+
+  dpr   = devicePixelRatioF();
+  dsize = (int) ceil(TILE_SIZE*dpr);
+
+  key.layer  = plot->layers[k];
+  key.xlev   = llround(log2(xa)*TILE_LEVELS);
+  key.ylev   = llround(log2(ya)*TILE_LEVELS);
+  key.i      = i;
+  key.j      = j;
+  key.colorF = state->colorF[k].rgb();
+  key.colorR = state->colorR[k].rgb();
+  key.thick  = state->thick[k];
+  key.idViz  = state->idViz;
+  key.heat   = heat;
+  key.dpr    = (int) lround(dpr*100.);
+
+  tile = tiles.object(key);
+  if (tile != NULL)
+    return (tile);
+
+#ifdef DEBUG
+  QElapsedTimer timer;
+  timer.start();
+#endif
+
+  tile = new QImage(dsize,dsize,QImage::Format_ARGB32_Premultiplied);
+  tile->setDevicePixelRatio(dpr);
+  tile->fill(Qt::transparent);
+
+  if (traceReads < 0)     //  out of reads, but whether this tile wanted any is yet to be seen
+    traceReads = 0;
+
+  { QPen        fPen, rPen;
+    QuadLeaf   *list, *curn, *next;
+    DotSegment *segs, *line;
+    Frame       query;
+    double      xb, yb;
+    int         n, m, d;
+
+    QVector<DotSegment *> visible;
+
+    layerPens(k,&fPen,&rPen);
+
+    xb = -1.*i*TILE_SIZE;
+    yb = -1.*j*TILE_SIZE;
+    query.x = (i*TILE_SIZE - TILE_MARGIN) / xa;
+    query.y = (j*TILE_SIZE - TILE_MARGIN) / ya;
+    query.w = (TILE_SIZE + 2*TILE_MARGIN) / xa;
+    query.h = (TILE_SIZE + 2*TILE_MARGIN) / ya;
+
+    segs = plot->layers[k]->segs;
+    list = Plot_Layer(plot,k,&query);
+
+    //  A heat map tile accumulates the aligned bp of each strand per device pixel straight
+    //    off the quad leaves
+
+    if (heat)
+      { QVector<uint32> bp(2*dsize*dsize,0);
+        uint32         *fheat, *rheat;
+
+        fheat = bp.data();
+        rheat = fheat + dsize*dsize;
+        for (curn = list; curn != NULL; curn = next)
+          { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
+            for ( ; curn->length > 0; curn++)
+              for (n = 0; n < curn->length; n++)
+                { line = segs + curn->idx[n];
+                  line->mark = 0;
+                  heat_line((line->bbeg < line->bend) ? fheat : rheat,dsize,dsize,
+                            (line->abeg*xa+xb)*dpr,(line->bbeg*ya+yb)*dpr,
+                            (line->aend*xa+xb)*dpr,(line->bend*ya+yb)*dpr,
+                            line->aend-line->abeg);
+                }
+          }
+        Free_List(list);
+
+        heat_tone(fheat,rheat,dsize,dsize,HEAT_DEPTH/((xa > ya ? xa : ya)*dpr),
+                  state->colorF[k].rgba(),state->colorR[k].rgba(),
+                  (uint32 *) tile->bits(),tile->bytesPerLine());
+
+        tiles.insert(key,tile,tile->sizeInBytes());
+        return (tile);
+      }
+
+    for (curn = list; curn != NULL; curn = next)
+      { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
+        for ( ; curn->length > 0; curn++)
+          for (n = 0; n < curn->length; n++)
+            { line = segs + curn->idx[n];
+              line->mark = 0;
+              visible.append(line);
+            }
+      }
+    m = visible.size();
+    Free_List(list);
+
+    //  The segments of every tile are drawn by the software rasterizer in device pixels, so
+    //    that a line crossing from a sparse tile to a dense one is drawn alike in both, save
+    //    for the segments to be drawn by local identity that are then painted over them
+
+    if (visible.size() > 0)
+      { QVector<RasterLine> lines(visible.size());
+        RasterLine *l;
+        uint32      fc, rc;
+        double      width;
+
+        fc    = qPremultiply(state->colorF[k].rgba());
+        rc    = qPremultiply(state->colorR[k].rgba());
+        width = fPen.widthF();
+        if (width <= 0.)
+          width = 1.;
+        width *= dpr;
+
+        m = d = 0;
+        for (n = 0; n < visible.size(); n++)
+          { line = visible[n];
+            l = lines.data() + m;
+            l->x0 = (line->abeg*xa+xb)*dpr;
+            l->y0 = (line->bbeg*ya+yb)*dpr;
+            l->x1 = (line->aend*xa+xb)*dpr;
+            l->y1 = (line->bend*ya+yb)*dpr;
+            if (state->idViz && (fabs(l->x1-l->x0) >= ID_MIN_PIXELS*dpr
+                                  || fabs(l->y1-l->y0) >= ID_MIN_PIXELS*dpr))
+              { visible[d++] = line;
+                continue;
+              }
+            l->color = (line->bbeg < line->bend) ? fc : rc;
+            m += 1;
+          }
+        raster_lines(lines.data(),m,width,(uint32 *) tile->bits(),dsize,dsize,tile->bytesPerLine(),
+                     visible.size() >= RASTER_MIN ? QThread::idealThreadCount() : 1);
+        visible.resize(d);
+      }
+
+    //  Then the segments left, those to be drawn by local identity, are painted with QPainter
+
+    if (visible.size() > 0)
+      { QPainter painter(tile);
+
+        painter.setRenderHint(QPainter::Antialiasing,true);
+        for (n = 0; n < visible.size(); n++)
+          drawSegment(painter,k,visible[n],fPen,rPen,xa,xb,ya,yb);
+      }
+
+#ifdef DEBUG
+    printf("Tile (%lld,%lld) of layer %d: %d segments in %.3fms\n",i,j,k,m,timer.nsecsElapsed()/1e6);
+    fflush(stdout);
+#endif
+  }
+
+  //  A tile drawn after the paint ran out of trace reads may lack some local identity, so
+  //    it is dropped at the start of the next paint (that paintEvent asks for) and redrawn
+
+  if (traceReads < 0)
+    partial.append(key);
+  tiles.insert(key,tile,tile->sizeInBytes());
+  return (tile);
+}
 
 void DotCanvas::paintEvent(QPaintEvent *event)
 { QPainter  painter;
@@ -779,6 +1333,14 @@ void DotCanvas::paintEvent(QPaintEvent *event)
   painter.setRenderHint(QPainter::Antialiasing,true);
   painter.setRenderHint(QPainter::SmoothPixmapTransform,true);
 
+  { int t;
+
+    for (t = 0; t < partial.length(); t++)
+      tiles.remove(partial[t]);
+    partial.clear();
+    traceReads = ID_READS;
+  }
+
   if (noFrame)    //  First paint => set Frame (cannot do earlier as do not know size)
     { viewToFrame();
       noFrame = false;
@@ -948,12 +1510,9 @@ void DotCanvas::paintEvent(QPaintEvent *event)
   painter.setClipRegion(QRect(cxb,cyb,cxe-cxb,cye-cyb));
 
   { QPen  iPen;           //  Draw scaffold / contig lines
-    int   i, j, x, y;
     int   alf, art;
     int   blf, brt;
-    int64 x8, y8;
     int           nsf1,  nsf2;
-    GDB_CONTIG   *ctg1, *ctg2;
     GDB_SCAFFOLD *scf1, *scf2;
 
     QVector<qreal> sdash;
@@ -962,65 +1521,40 @@ void DotCanvas::paintEvent(QPaintEvent *event)
     QVector<qreal> cdash;
     cdash << 1 << 4;
 
-    ctg1 = plot->db1->gdb.contigs;
     scf1 = plot->db1->gdb.scaffolds;
     nsf1 = plot->db1->gdb.nscaff-1;
-    alf = art = 0;
-    for (i = 1; i < nsf1; i++)
-      { x8 = ctg1[scf1[i].fctg].sbeg;
-        x  = (int) (x8*xa+xb);
-        if (x >= 22)
-          { if (x <= rectW-22)
-              { art = i;
-                // painter.drawLine(x,cyb,x,cye);
-              }
-          }
-        else
-          alf = i;
-      }
+    alf = lastBoundary(plot->db1,false,nsf1,xa,xb,21);
+    art = lastBoundary(plot->db1,false,nsf1,xa,xb,rectW-22);
     if (art < alf)
       art = alf;
 
-    ctg2 = plot->db2->gdb.contigs;
     scf2 = plot->db2->gdb.scaffolds;
     nsf2 = plot->db2->gdb.nscaff-1;
-    blf = brt = 0;
-    for (i = 1; i < nsf2; i++)
-      { y8 = ctg2[scf2[i].fctg].sbeg;
-        y  = (int) (y8*ya+yb);
-        if (y >= 22)
-          { if (y <= rectH+22)
-              { brt = i;
-                // painter.drawLine(cxb,y,cxe,y);
-              }
-          }
-        else
-          blf = i;
-      }
+    blf = lastBoundary(plot->db2,false,nsf2,ya,yb,21);
+    brt = lastBoundary(plot->db2,false,nsf2,ya,yb,rectH+22);
     if (brt < blf)
       brt = blf;
 
     if ((art-alf <= 2 || scf1[art].ectg - scf1[alf].fctg <= 20) &&
         (brt-blf <= 2 || scf2[brt].ectg - scf2[blf].fctg <= 20) )
-      { iPen.setColor(QColor(200,200,255));
+      { int nct1, nct2;
+
+        iPen.setColor(QColor(200,200,255));
         iPen.setWidth(1);
         iPen.setDashPattern(cdash);
         painter.setPen(iPen);
 
-        for (j = alf; j <= art; j++)
-          for (i = scf1[j].fctg+1; i < scf1[j].ectg; i++)
-            { x8 = ctg1[i].sbeg;
-              x  = (int) (x8*xa+xb);
-              if (x >= 22 && x <= rectW-22)
-                painter.drawLine(x,cyb,x,cye);
-            }
-        for (j = blf; j <= brt; j++)
-          for (i = scf2[j].fctg+1; i < scf2[j].ectg; i++)
-            { y8 = ctg2[i].sbeg;
-              y  = (int) (y8*ya+yb);
-              if (y >= 22 && y <= rectH+22)
-                painter.drawLine(cxb,y,cxe,y);
-            }
+        nct1 = plot->db1->gdb.ncontig;
+        drawBoundaries(painter,plot->db1,true,nct1,xa,xb,
+                       lastBoundary(plot->db1,true,nct1,xa,xb,21),
+                       lastBoundary(plot->db1,true,nct1,xa,xb,rectW-22),
+                       22,rectW-22,true,cyb,cye);
+
+        nct2 = plot->db2->gdb.ncontig;
+        drawBoundaries(painter,plot->db2,true,nct2,ya,yb,
+                       lastBoundary(plot->db2,true,nct2,ya,yb,21),
+                       lastBoundary(plot->db2,true,nct2,ya,yb,rectH+22),
+                       22,rectH+22,false,cxb,cxe);
 
         iPen.setColor(QColor(255,255,255));
         iPen.setWidth(1);
@@ -1034,180 +1568,161 @@ void DotCanvas::paintEvent(QPaintEvent *event)
         painter.setPen(iPen);
       }
 
-    for (i = 1; i < nsf1; i++)
-      { x8 = ctg1[scf1[i].fctg].sbeg;
-        x  = (int) (x8*xa+xb);
-        if (x >= 22 && x <= rectW-22)
-          painter.drawLine(x,cyb,x,cye);
-      }
-
-    for (i = 1; i < nsf2; i++)
-      { y8 = ctg2[scf2[i].fctg].sbeg;
-        y  = (int) (y8*ya+yb);
-        if (y >= 22 && y <= rectH+22)
-          painter.drawLine(cxb,y,cxe,y);
-      }
+    drawBoundaries(painter,plot->db1,false,nsf1,xa,xb,alf,art,22,rectW-22,true,cyb,cye);
+    drawBoundaries(painter,plot->db2,false,nsf2,ya,yb,blf,brt,22,rectH+22,false,cxb,cxe);
   }
 
-  { QuadLeaf *list;
-    QPen      pPen;
+  { QPen      pPen;
     int       j, k;
-    int       Thickint[5] = { 0, 1, 0, 2, 3 };
-    qreal     Thickreal[5] = { .5, 0, 1.5, 0, 0 };
 
     pPen.setBrush(QBrush(QColor(255,255,255),Qt::Dense2Pattern));
     pPen.setWidth(5);
 
+    //  Size the tile cache to hold TILE_FRAMES views of every visible line layer
+
+    { int64 dsize, cost;
+
+      dsize = (int64) ceil(TILE_SIZE*devicePixelRatioF());
+      cost  = 0;
+      for (k = 1; k < state->nlays; k++)
+        if (state->on[k])
+          cost += TILE_FRAMES * (rectW/TILE_SIZE+2) * (rectH/TILE_SIZE+2) * 4*dsize*dsize;
+      if (cost < TILE_CACHE_MEMORY)
+        cost = TILE_CACHE_MEMORY;
+      if (cost != tiles.maxCost())
+        tiles.setMaxCost(cost);
+    }
+
     for (j = 0; j < state->nlays; j++)
       { k = state->order[j];
         if ( ! state->on[k])
           continue;
 
         if (k == 0)
-          { int   r, g, b;
-            int   kmer, klen;
-            Dots *dot;
+          { int  kmer, cap;
+            bool mask;
 
-            if (state->view.w > 1000000)
+            if (Indexing)
               continue;
 
             kmer = state->thick[0]+8;
-            klen = kmer*xa;
-
-            if (image == NULL || rectW != image->width() || rectH != image->height() ||
-                (image->format() == QImage::Format_MonoLSB) == (klen >= 3))
-              { if (image != NULL)
-                  delete image;
-                if (klen >= 3)
-                  image = new QImage(rectW,rectH,QImage::Format_RGB32);
-                else
-                  { image = new QImage(rectW,rectH,QImage::Format_MonoLSB);
-                    for (r = 0; r < rectH; r++)
-                      raster[r] = image->scanLine(r); 
-                  }
-              }                  
 
-            if (klen < 3)
-              image->setColorTable(ctable);
-            image->fill(0);
+            if ( ! dotindexed(plot,kmer))
+              { if (state->view.w > MAX_DOTPLOT)
+                  continue;
 
-            dot  = dotplot(plot,kmer,&(state->view));
+                //  The dot plot will read sequence: read ahead around the view.  Without
+                //    the read-ahead the plot is only slower, so a failure is not retried.
 
-            { int  i, x;
-              int *aplot = dot->aplot;
+                if (prefetch == NULL && ! noPrefetch)
+                  { prefetch = New_Prefetcher(plot);
+                    noPrefetch = (prefetch == NULL);
+                  }
+                if (prefetch != NULL)
+                  Prefetch_View(prefetch,&(state->view));
+              }
 
-              for (i = 0; i < dot->ahit; i++)
-                { x = aplot[i];
-                  if (x >= 0)
-                    aplot[i] = ((int) floor(xa*x+22.));
+            cap  = DotCaps[state->dotCap];
+            mask = state->dotMask;
+
+            //  Start a job for the current view if neither the image shown nor the one
+            //    being computed is for it, cancelling any now stale job.
+
+            if (dotShown == NULL || ! dotShown->sameAs(&(state->view),kmer,cap,mask,
+                                                       rectW,rectH,state->colorF[0]))
+              if (dotPending == NULL || ! dotPending->sameAs(&(state->view),kmer,cap,mask,
+                                                             rectW,rectH,state->colorF[0]))
+                { if (dotPending != NULL)
+                    dotPending->cancel();
+                  dotPending = new DotJob(plot,&(state->view),kmer,cap,mask,
+                                          rectW,rectH,state->colorF[0]);
+                  connect(dotPending,SIGNAL(finished()),this,SLOT(dotsDone()));
+                  dotJobs += dotPending;
+                  dotPending->start();
                 }
-            }
 
-            r = state->colorF[0].red();
-            g = state->colorF[0].green();
-            b = state->colorF[0].blue();
-
-            if (klen >= 3)
-              { QPainter dotter(image);
-                QPen     dPen;
-                int     *aplot = dot->aplot;
-                Tuple   *blist = dot->blist;
-                int      i, x, y, k;
-
-                dPen.setColor(QColor(r,g,b));
-                dPen.setWidth(1);
-
-                dotter.setRenderHint(QPainter::Antialiasing,true);
-                dotter.setClipRegion(QRect(22,22,rectW-22,rectH-22));
-                dotter.setPen(dPen);
-
-                for (i = 0; i < dot->brun; i++)
-                  { y = (int) floor(ya*blist[i].pos+22.);
-                    k = blist[i].code;
-                    while (1)
-                      { x = aplot[k++];
-                        if (x < 0)
-                          break;
-                        dotter.drawLine(x,y,x+klen,y+klen);
-                      }
+            //  Paint the last result, scaled and shifted to the current frame if need be
+
+            if (dotShown != NULL)
+              { QImage *img = dotShown->image;
+                double  w   = img->width();
+                double  h   = img->height();
+                double  gx  = dotShown->view.x - 22./dotShown->xa;
+                double  gy  = dotShown->view.y - 22./dotShown->ya;
+
+                painter.drawImage(QRectF(xa*gx+xb,ya*gy+yb,w*(xa/dotShown->xa),h*(ya/dotShown->ya)),
+                                  *img,QRectF(0.,0.,w,h));
+
+                if (dotShown->counts.ncap > 0)
+                  { painter.setPen(QColor(192,192,192));
+                    painter.drawText(QRect(26,rectH-40,rectW-52,14),Qt::AlignLeft|Qt::AlignBottom,
+                                     tr("%1 k-mers over cap of %2 suppressed (%3 hits)")
+                                         .arg(dotShown->counts.ncap).arg(cap)
+                                         .arg(dotShown->counts.ncapped));
                   }
-              }
-            else
-              { int i, x, k; 
-                uint8 *ras;
-                int   *aplot = dot->aplot;
-                Tuple *blist = dot->blist;
-
-                ctable[0] = qRgb(0,0,0);
-                ctable[1] = qRgb(r,g,b);
-                for (r = 0; r < 8; r++)
-                  imbit[r] = (1<<r); 
-
-                for (i = 0; i < dot->brun; i++)
-                  { ras = raster[((int) floor(ya*blist[i].pos+22.))];
-                    k = blist[i].code;
-                    while (1)
-                      { x = aplot[k++];
-                        if (x < 0)
-                          break;
-                        ras[x>>3] |= imbit[x&0x7];
-                      }
+                if (dotShown->counts.sample > 1)
+                  { painter.setPen(QColor(192,192,192));
+                    painter.drawText(QRect(26,rectH-54,rectW-52,14),Qt::AlignLeft|Qt::AlignBottom,
+                                     tr("View too large for the index: 1 in %1 k-mers shown")
+                                         .arg(dotShown->counts.sample));
                   }
               }
 
-            painter.drawImage(QPoint(0,0),*image);
-
             continue;
           }
 
-        list = Plot_Layer(plot,k,&frame);
-
-        { QPen        fPen, rPen;
-          QuadLeaf   *curn, *next;
-          DotSegment *segs, *line;
-          int         xbeg, xend;
-          int         ybeg, yend;
-          int         i;
-    
-          fPen.setColor(state->colorF[k]);
-          rPen.setColor(state->colorR[k]);
-          i = state->thick[k];
-          if (i == 0 || i == 2)
-            { fPen.setWidthF(Thickreal[i]);
-              rPen.setWidthF(Thickreal[i]);
-            }
-          else
-            { fPen.setWidth(Thickint[i]);
-              rPen.setWidth(Thickint[i]);
-            }
+        //  Blit the tiles of the layer covering the plot area, rendering those not cached,
+        //    then the highlight of a picked segment of the layer
+
+        { QImage *tile;
+          int64   ib, ie, jb, je;
+          int64   ti, tj;
+          int     ox, oy;
+          bool    heat;
+
+          ox = (int) floor(xb+.5);
+          oy = (int) floor(yb+.5);
+          ib = (int64) floor((cxb-ox)/(1.*TILE_SIZE));
+          ie = (int64) floor((cxe-ox)/(1.*TILE_SIZE));
+          jb = (int64) floor((cyb-oy)/(1.*TILE_SIZE));
+          je = (int64) floor((cye-oy)/(1.*TILE_SIZE));
+
+          //  The layer is drawn as a heat map if the view holds more alignments than can
+          //    be told apart, decided once for all its tiles from the quad tree sums: the
+          //    a-bp aligned in the view, each segment clipped to it, times the pixels per bp
+          //    of the longer axis is about the # of pixels its lines cross
+
+          { RegionStats stats;
+            Frame       area;
+
+            area.x = (cxb-xb)/xa;
+            area.y = (cyb-yb)/ya;
+            area.w = (cxe-cxb)/xa;
+            area.h = (cye-cyb)/ya;
+            heat   = false;
+            if (area.w > 0. && area.h > 0.)
+              { Region_Stats(plot,k,&area,&stats);
+                heat = (stats.abp*(xa > ya ? xa : ya)*HEAT_PIXELS >= (cxe-cxb)*(cye-cyb));
+              }
+          }
 
-          segs = plot->layers[k]->segs;
-          for (curn = list; curn != NULL; curn = next)
-            { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
-              while (curn->length > 0)
-                { for (i = 0; i < curn->length; i++)
-                    { line = segs + curn->idx[i];
-                      xbeg = (int) (line->abeg*xa+xb);
-                      ybeg = (int) (line->bbeg*ya+yb);
-                      xend = (int) (line->aend*xa+xb);
-                      yend = (int) (line->bend*ya+yb);
-                      if (line == pickedSeg)
-                        { painter.setPen(pPen);
-                          painter.drawLine(xbeg,ybeg,xend,yend);
-                        }
-                      if (line->bbeg < line->bend)
-                        painter.setPen(fPen);
-                      else
-                        painter.setPen(rPen);
-                      painter.drawLine(xbeg,ybeg,xend,yend);
-                      line->mark = 0;
-                    }
-                  curn += 1;
-                }
-            }
+          for (tj = jb; tj <= je; tj++)
+            for (ti = ib; ti <= ie; ti++)
+              { tile = layerTile(k,ti,tj,xa,ya,heat);
+                if (tile != NULL)
+                  painter.drawImage(QPoint((int) (ti*TILE_SIZE+ox),(int) (tj*TILE_SIZE+oy)),*tile);
+              }
         }
 
-        Free_List(list);
+        if (pickedSeg != NULL && pickedLayer == plot->layers[k])
+          { QPen fPen, rPen;
+
+            layerPens(k,&fPen,&rPen);
+            painter.setPen(pPen);
+            painter.drawLine((int) (pickedSeg->abeg*xa+xb),(int) (pickedSeg->bbeg*ya+yb),
+                             (int) (pickedSeg->aend*xa+xb),(int) (pickedSeg->bend*ya+yb));
+            drawSegment(painter,k,pickedSeg,fPen,rPen,xa,xb,ya,yb);
+          }
       }
   }
 
@@ -1299,6 +1814,9 @@ void DotCanvas::paintEvent(QPaintEvent *event)
     }
 
   painter.end();
+
+  if (partial.length() > 0)    //  finish the local identity of partial tiles
+    update();
 }
 
 
@@ -1415,6 +1933,10 @@ void DotWindow::activateLayer(int act)
       layerRBox[j]->setEnabled(on);
       layerRText[j]->setEnabled(on);
       layerThick[j]->setEnabled(on);
+      if (j == 0)
+        { dotCapBox->setEnabled(on);
+          dotMaskBox->setEnabled(on);
+        }
     }
 
   update();
@@ -1458,24 +1980,336 @@ void DotWindow::layerRChange()
 /*                                                                                     */
 /***************************************************************************************/
 
-AlignWindow::AlignWindow(QString title, char *align, QWidget *parent, Qt::WindowFlags flags) : QMainWindow(parent,flags)
-{
-  edit = new QTextEdit();
-  edit->setCurrentFont(QFont(tr("Monaco"),11));
-  edit->setPlainText(tr(align));
-  edit->setReadOnly(true);
-  edit->setWordWrapMode(QTextOption::NoWrap);
-  edit->setLineWrapMode(QTextEdit::NoWrap);
+//  An AlignThread computes an alignment off the GUI thread.  Each has its own job, and so
+//    its own alignment working storage, so any number can run at once.
+
+AlignThread::AlignThread(AlignJob *j) : QThread()
+{ job  = j;
+  done = false;
+  halt = 0;
+}
+
+AlignThread::~AlignThread()
+{ Free_Align_Job(job); }
+
+void AlignThread::cancel()
+{ halt = 1; }
+
+void AlignThread::run()
+{ done = (Run_Align_Job(job,QThread::idealThreadCount(),&halt) == 0 && ! halt);
+  if ( ! done && ! halt)
+    error = tr(EPLACE);
+}
+
+//  An ExportThread computes and writes the alignments of a region export off the GUI thread
+
+ExportThread::ExportThread(RegionExport *e, int n) : QThread()
+{ ex       = e;
+  nthreads = n;
+  done     = 0;
+  ok       = false;
+  halt     = 0;
+}
+
+void ExportThread::cancel()
+{ halt = 1; }
+
+void ExportThread::run()
+{ ok = (Run_Region_Export(ex,nthreads,&halt,&done) == 0 && ! halt);
+  if ( ! ok && ! halt)
+    error = tr(EPLACE);
+}
+
+//  An IndexThread builds the dot plot minimizer indices of a plot off the GUI thread
+
+IndexThread::IndexThread(DotPlot *p, int n) : QThread()
+{ plot     = p;
+  nthreads = n;
+  done     = 0;
+  ok       = false;
+  halt     = 0;
+}
+
+void IndexThread::cancel()
+{ halt = 1; }
+
+void IndexThread::run()
+{ ok = (Index_DotPlot(plot,nthreads,&halt,&done) == 0 && ! halt);
+  if ( ! ok && ! halt)
+    error = tr(EPLACE);
+}
+
+//  An AlignView shows the rows of a computed alignment, formatting only those currently
+//    scrolled into view on each paint, so the cost of scrolling and the memory used do not
+//    depend on the length of the alignment.  Whole rows are selected by dragging (or all
+//    with Ctrl+A) and Ctrl+C or the context menu copies them to the clipboard as text.
+
+AlignView::AlignView(QWidget *parent) : QAbstractScrollArea(parent)
+{ QFont font = QFont(tr("Monaco"),11);
+
+  font.setStyleHint(QFont::TypeWriter);
+  setFont(font);
+  viewport()->setFont(font);
+
+  QFontMetrics met = QFontMetrics(font);
+  lineH = met.lineSpacing();
+  lineW = met.boundingRect(QString(ALIGN_ROW_MAX,QChar('8'))).width() + 8;
+
+  job  = NULL;
+  selA = selB = -1;
+  verticalScrollBar()->setSingleStep(1);
+  setRanges();
+
+  copyAct = new QAction(tr("Copy"),this);
+    copyAct->setShortcut(tr("Ctrl+C"));
+    copyAct->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+  allAct = new QAction(tr("Select All"),this);
+    allAct->setShortcut(tr("Ctrl+A"));
+    allAct->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+
+  connect(copyAct,SIGNAL(triggered()),this,SLOT(copyRows()));
+  connect(allAct,SIGNAL(triggered()),this,SLOT(selectAll()));
+
+  addAction(copyAct);
+  addAction(allAct);
+  setContextMenuPolicy(Qt::ActionsContextMenu);
+  setFocusPolicy(Qt::StrongFocus);
+}
+
+void AlignView::setJob(AlignJob *j)
+{ job  = j;
+  selA = selB = -1;
+  message.clear();
+  verticalScrollBar()->setValue(0);
+  setRanges();
+  viewport()->update();
+}
+
+void AlignView::setMessage(const QString &m)
+{ job  = NULL;
+  selA = selB = -1;
+  message = m;
+  setRanges();
+  viewport()->update();
+}
+
+//  The vertical scroll bar is in rows, the horizontal one in pixels
+
+void AlignView::setRanges()
+{ int64 rows;
+  int   vis;
+
+  vis = viewport()->height() / lineH;
+  if (job == NULL)
+    rows = 0;
+  else
+    rows = Align_Job_Rows(job);
+  verticalScrollBar()->setPageStep(vis);
+  if (rows > vis)
+    verticalScrollBar()->setRange(0,rows-vis);
+  else
+    verticalScrollBar()->setRange(0,0);
+
+  horizontalScrollBar()->setPageStep(viewport()->width());
+  horizontalScrollBar()->setSingleStep(lineH);
+  if (job != NULL && lineW > viewport()->width())
+    horizontalScrollBar()->setRange(0,lineW - viewport()->width());
+  else
+    horizontalScrollBar()->setRange(0,0);
+}
+
+void AlignView::resizeEvent(QResizeEvent *event)
+{ (void) event;
+  setRanges();
+}
+
+void AlignView::paintEvent(QPaintEvent *event)
+{ QPainter painter(viewport());
+  char     row[ALIGN_ROW_MAX];
+  int64    r, rows, lo, hi;
+  int      x, y, w, h;
+
+  (void) event;
 
-  setCentralWidget(edit);
-  setWindowTitle(title);
+  painter.fillRect(viewport()->rect(),palette().color(QPalette::Base));
+  painter.setPen(palette().color(QPalette::Text));
+
+  QFontMetrics met = QFontMetrics(font());
+
+  if (job == NULL)
+    { painter.drawText(4,met.ascent()+2,message);
+      return;
+    }
+
+  if (selA <= selB)
+    { lo = selA;
+      hi = selB;
+    }
+  else
+    { lo = selB;
+      hi = selA;
+    }
+
+  rows = Align_Job_Rows(job);
+  w    = viewport()->width();
+  h    = viewport()->height();
+  x    = 4 - horizontalScrollBar()->value();
+  y    = met.ascent()+2;
+  for (r = verticalScrollBar()->value(); r < rows && y-met.ascent() < h; r++)
+    { if (selA >= 0 && r >= lo && r <= hi)
+        { painter.fillRect(0,y-met.ascent(),w,lineH,palette().color(QPalette::Highlight));
+          painter.setPen(palette().color(QPalette::HighlightedText));
+          painter.drawText(x,y,QString::fromLatin1(Align_Job_Row(job,r,row)));
+          painter.setPen(palette().color(QPalette::Text));
+        }
+      else
+        painter.drawText(x,y,QString::fromLatin1(Align_Job_Row(job,r,row)));
+      y += lineH;
+    }
+}
+
+//  Return the row under viewport y-coordinate y, clipped to the rows of the alignment
+
+int64 AlignView::rowAt(int y)
+{ int64 r, rows;
+
+  if (y < 2)
+    r = verticalScrollBar()->value() - 1;
+  else
+    r = verticalScrollBar()->value() + (y-2)/lineH;
+  rows = Align_Job_Rows(job);
+  if (r >= rows)
+    r = rows-1;
+  if (r < 0)
+    r = 0;
+  return (r);
+}
+
+void AlignView::mousePressEvent(QMouseEvent *event)
+{ if (job == NULL || event->button() != Qt::LeftButton)
+    return;
+  selA = selB = rowAt(event->position().toPoint().y());
+  viewport()->update();
+}
+
+//  Dragging above or below the viewport scrolls it a row at a time
+
+void AlignView::mouseMoveEvent(QMouseEvent *event)
+{ int y;
+
+  if (job == NULL || selA < 0 || (event->buttons() & Qt::LeftButton) == 0)
+    return;
+  y = event->position().toPoint().y();
+  if (y < 0)
+    verticalScrollBar()->setValue(verticalScrollBar()->value()-1);
+  else if (y >= viewport()->height())
+    verticalScrollBar()->setValue(verticalScrollBar()->value()+1);
+  selB = rowAt(y);
+  viewport()->update();
+}
+
+void AlignView::selectAll()
+{ if (job == NULL)
+    return;
+  selA = 0;
+  selB = Align_Job_Rows(job)-1;
+  viewport()->update();
+}
+
+void AlignView::copyRows()
+{ char    row[ALIGN_ROW_MAX];
+  QString text;
+  int64   r, lo, hi;
+
+  if (job == NULL || selA < 0)
+    return;
+  if (selA <= selB)
+    { lo = selA;
+      hi = selB;
+    }
+  else
+    { lo = selB;
+      hi = selA;
+    }
+  for (r = lo; r <= hi; r++)
+    { text += QString::fromLatin1(Align_Job_Row(job,r,row));
+      text += QChar('\n');
+    }
+  QGuiApplication::clipboard()->setText(text);
+}
+
+//  An alignment window opens at once with a busy indicator while its alignment is computed
+//    in the background, and shows the alignment when it is done.  Closing the window or
+//    pressing Cancel abandons the computation, and closing it deletes it and so frees its
+//    alignment job.
+
+AlignWindow::AlignWindow(AlignJob *job, QWidget *parent, Qt::WindowFlags flags) : QMainWindow(parent,flags)
+{ setAttribute(Qt::WA_DeleteOnClose);
+
+  view = new AlignView();
+  view->setMessage(tr("Computing alignment ..."));
+
+  progress = new QProgressBar();
+  progress->setRange(0,0);
+  progress->setMaximumWidth(200);
+
+  cancelButton = new QPushButton(tr("Cancel"));
+
+  statusBar()->addPermanentWidget(progress);
+  statusBar()->addPermanentWidget(cancelButton);
+
+  setCentralWidget(view);
+  setWindowTitle(tr(Align_Job_Title(job)));
 
   setMinimumWidth(820);
   setMinimumHeight(500);
 
+  thread = new AlignThread(job);
+
+  connect(cancelButton,SIGNAL(clicked()),this,SLOT(cancelAlign()));
+  connect(thread,SIGNAL(finished()),this,SLOT(alignDone()));
+
+  thread->start();
+
   raise();
 }
 
+AlignWindow::~AlignWindow()
+{ stopAlign();
+  view->setJob(NULL);
+  delete thread;
+}
+
+//  Cancel the computation if it is still running and wait for it to stop.  Must be called
+//    before the plot the alignment is from is freed.
+
+void AlignWindow::stopAlign()
+{ thread->cancel();
+  thread->wait();
+}
+
+void AlignWindow::closeEvent(QCloseEvent *event)
+{ thread->cancel();
+  ((DotWindow *) parentWidget())->removeTextBox(this);
+  event->accept();
+}
+
+void AlignWindow::cancelAlign()
+{ thread->cancel();
+  cancelButton->setEnabled(false);
+  view->setMessage(tr("Cancelling ..."));
+}
+
+void AlignWindow::alignDone()
+{ statusBar()->hide();
+  if (thread->done)
+    view->setJob(thread->job);
+  else if (thread->error.isEmpty())
+    view->setMessage(tr("Alignment cancelled"));
+  else
+    view->setMessage(thread->error);
+}
+
 
 /***************************************************************************************/
 /*                                                                                     */
@@ -1503,6 +2337,70 @@ void DotWindow::openCopy()
   dotwindows += dot;
 }
 
+void DotWindow::buildIndex()
+{ int64 total;
+  int   i;
+
+  //  Windows may share these genomes, so all must stop their dot plot jobs before the
+  //    indices are remapped, and none may start another until it is done
+
+  Indexing = true;
+  for (i = 0; i < dotwindows.length(); i++)
+    dotwindows[i]->canvas->cancelDots();
+
+  total = plot->db1->gdb.seqtot;
+  if (plot->db2 != plot->db1)
+    total += plot->db2->gdb.seqtot;
+  if (total <= 0)
+    total = 1;
+
+  QProgressDialog progress(tr("Building dot plot indices ..."),tr("Cancel"),0,1000,this);
+  progress.setWindowModality(Qt::ApplicationModal);
+  progress.setMinimumDuration(500);
+
+  IndexThread thread(plot,QThread::idealThreadCount());
+  thread.start();
+  while ( ! thread.wait(100))
+    { progress.setValue((int) ((1000*thread.done)/total));
+      if (progress.wasCanceled())
+        thread.cancel();
+    }
+  progress.reset();
+  Indexing = false;
+
+  if ( ! thread.ok && ! thread.error.isEmpty())
+    DotWindow::warning(thread.error,this,DotWindow::ERROR,tr("OK"));
+
+  for (i = 0; i < dotwindows.length(); i++)
+    dotwindows[i]->canvas->update();
+}
+
+void DotWindow::cacheStats()
+{ int64 hits, misses, bytes;
+  int64 ahits, amisses, abytes;
+  double rate, arate;
+
+  Cache_Stats(plot,&hits,&misses,&bytes);
+  if (hits+misses > 0)
+    rate = (100.*hits)/(hits+misses);
+  else
+    rate = 0.;
+  Align_Cache_Stats(&ahits,&amisses,&abytes);
+  if (ahits+amisses > 0)
+    arate = (100.*ahits)/(ahits+amisses);
+  else
+    arate = 0.;
+  DotWindow::warning(tr("Sequence cache: %1 chunk hits, %2 misses (%3% hit rate)\n"
+                        "%4 MB of decoded sequence held\n\n"
+                        "Alignment cache: %5 hits, %6 misses (%7% hit rate)\n"
+                        "%8 MB of computed alignments held")
+                       .arg(hits).arg(misses).arg(rate,0,'f',1)
+                       .arg(bytes/1048576.,0,'f',1)
+                       .arg(ahits).arg(amisses).arg(arate,0,'f',1)
+                       .arg(abytes/1048576.,0,'f',1),
+                     this,DotWindow::INFORM,tr("OK"));
+}
+
 void DotWindow::openFile()    // static
 { Open_State ostate;
   DotState  *sptr;
@@ -1522,6 +2420,7 @@ tryagain:
       return;
     }
 
+  Set_GDB_Cache(dataset.cacheOn ? dataset.cacheDir.toLatin1().data() : NULL);
   plot = createPlot(dataset.alnInfo->absoluteFilePath().toLatin1().data(),
                     dataset.longCut,dataset.idCut,dataset.sizeCut,NULL);
   if (plot == NULL)
@@ -1559,6 +2458,7 @@ void DotWindow::openOverlay()
       return;
     }
 
+  Set_GDB_Cache(dataset.cacheOn ? dataset.cacheDir.toLatin1().data() : NULL);
   nplot = createPlot(dataset.alnInfo->absoluteFilePath().toLatin1().data(),
                      dataset.longCut,dataset.idCut,dataset.sizeCut,plot);
   if (nplot == NULL)
@@ -1760,6 +2660,16 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
           layerThick[j]->addItem(tr("3"));
         }
 
+      if (j == 0)
+        { dotCapBox = new QComboBox();
+            dotCapBox->addItem(tr("No cap"));
+            for (int k = 1; k < NUM_DOT_CAPS; k++)
+              dotCapBox->addItem(tr("Cap %1").arg(DotCaps[k]));
+            dotCapBox->setToolTip(tr("Suppress k-mers occurring more often than this in the view"));
+          dotMaskBox = new QCheckBox(tr("Mask"));
+            dotMaskBox->setToolTip(tr("Exclude soft-masked sequence"));
+        }
+
       QLabel *layb = new QLabel();
         layb->setFixedSize(16,16);
         layb->setPixmap(upd);
@@ -1787,6 +2697,12 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
             layerLayout2->addSpacing(6);
           }
 	layerLayout2->addWidget(layerThick[j]);
+        if (j == 0)
+          { layerLayout2->addSpacing(6);
+            layerLayout2->addWidget(dotCapBox);
+            layerLayout2->addSpacing(6);
+            layerLayout2->addWidget(dotMaskBox);
+          }
 	layerLayout2->addStretch(1);
 
       QVBoxLayout *layerLayout3 = new QVBoxLayout();
@@ -1822,9 +2738,18 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
 
   QLabel *layerMaster = new QLabel(tr("Layers:"));
 
+  idVizBox = new QCheckBox(tr("Local identity"));
+    idVizBox->setToolTip(tr("Color alignments by the identity of each trace point interval"));
+
+  QHBoxLayout *layerHeader = new QHBoxLayout();
+    layerHeader->setContentsMargins(0,0,0,0);
+    layerHeader->addWidget(layerMaster);
+    layerHeader->addStretch(1);
+    layerHeader->addWidget(idVizBox);
+
   QVBoxLayout *layerMargin = new QVBoxLayout();
     layerMargin->setContentsMargins(2,15,2,2);
-    layerMargin->addWidget(layerMaster);
+    layerMargin->addLayout(layerHeader);
     layerMargin->addWidget(layerArea);
 
       QLabel *locatorLabel = new QLabel(tr("Navi: "));
@@ -1902,6 +2827,17 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
         panelColor.setColor(QPalette::Active,QPalette::Window,QColor(200,200,220));
         panel->setPalette(panelColor);
 
+  statsPanel = new QLabel();
+    statsPanel->setFrameStyle(QFrame::StyledPanel|QFrame::Plain);
+    statsPanel->setLineWidth(1);
+    statsPanel->setAutoFillBackground(true);
+    statsPanel->setText(tr("%1<br>%2<br>%3")
+                              .arg("<b>Statistics:</b>")
+                              .arg("&nbsp;&nbsp;Select a region or pick")
+                              .arg("&nbsp;&nbsp;for those of its alignments"));
+    statsPanel->setAlignment(Qt::AlignLeft|Qt::AlignTop);
+    statsPanel->setPalette(panelColor);
+
   QVBoxLayout *controlLayout = new QVBoxLayout;
     controlLayout->addStrut(120);
     controlLayout->addLayout(zoomLayout);
@@ -1913,6 +2849,8 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
     controlLayout->addLayout(layerMargin);
     controlLayout->addSpacing(5);
     controlLayout->addLayout(locatorLayout);
+    controlLayout->addSpacing(5);
+    controlLayout->addWidget(statsPanel);
     controlLayout->addWidget(panel);
 
   QWidget *controlPart = new QWidget;
@@ -2002,6 +2940,9 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
           state.colorR[j] = startState->colorR[j];
           state.thick[j] = startState->thick[j];
         }
+      state.dotCap  = startState->dotCap;
+      state.dotMask = startState->dotMask;
+      state.idViz   = startState->idViz;
       if (plot->db1->gdb.seqs == NULL || plot->db2->gdb.seqs == NULL)
         layerOn[0]->setEnabled(false);
     }
@@ -2043,6 +2984,9 @@ DotWindow::DotWindow(DotPlot *model, DotState *startState, bool isCopy) : QMainW
       connect(layerRBox[j],SIGNAL(pressed()),this,SLOT(layerRChange()));
       connect(layerThick[j],SIGNAL(currentIndexChanged(int)),this,SLOT(thickChange(int)));
     }
+  connect(dotCapBox,SIGNAL(currentIndexChanged(int)),this,SLOT(dotCapChange(int)));
+  connect(dotMaskBox,SIGNAL(stateChanged(int)),this,SLOT(dotMaskChange()));
+  connect(idVizBox,SIGNAL(stateChanged(int)),this,SLOT(idVizChange()));
 
   connect(locatorCheck,SIGNAL(stateChanged(int)),this,SLOT(locatorChange()));
   connect(locatorBox,SIGNAL(clicked()),this,SLOT(locatorColorChange()));
@@ -2111,6 +3055,18 @@ void DotWindow::createActions()
   connect(copyAct, SIGNAL(triggered()), this, SLOT(openCopy()));
   connect(exitAct, SIGNAL(triggered()), this, SLOT(closeAll()));
 
+  indexAct = new QAction(tr("Build Dot Plot Index"), this);
+    indexAct->setToolTip(tr("Build minimizer indices for instant k-mer dot plots at any zoom"));
+    indexAct->setEnabled(plot->db1->gdb.seqs != NULL && plot->db2->gdb.seqs != NULL);
+
+  connect(indexAct, SIGNAL(triggered()), this, SLOT(buildIndex()));
+
+  cacheAct = new QAction(tr("Cache Statistics"), this);
+    cacheAct->setToolTip(tr("Show how often alignment sequence and computed alignments were served from memory"));
+    cacheAct->setEnabled(plot->db1->gdb.seqs != NULL && plot->db2->gdb.seqs != NULL);
+
+  connect(cacheAct, SIGNAL(triggered()), this, SLOT(cacheStats()));
+
   connect(unminimizeAllAct, SIGNAL(triggered()), this, SLOT(unminimizeAll()));
   connect(raiseAllAct, SIGNAL(triggered()), this, SLOT(raiseAll()));
 
@@ -2145,6 +3101,9 @@ void DotWindow::createMenus()
   QMenu *fileMenu = bar->addMenu(tr("&File"));
     fileMenu->addAction(openAct);
     fileMenu->addSeparator();
+    fileMenu->addAction(indexAct);
+    fileMenu->addAction(cacheAct);
+    fileMenu->addSeparator();
     fileMenu->addAction(exitAct);
 
   QMenu *imageMenu = bar->addMenu(tr("&Image"));
@@ -2180,10 +3139,10 @@ void DotWindow::frameToView(double newZ)
   if (newZ > 0.)
     state.zoom = newZ;
 
-  s = Map_Coord(&(plot->db1->gdb),state.view.x,state.view.x+state.view.w,state.format,state.view.w);
+  s = Map_Coord(plot->db1,state.view.x,state.view.x+state.view.w,state.format,state.view.w);
   Arng->setText(tr("%1").arg(s));
 
-  s = Map_Coord(&(plot->db2->gdb),state.view.y,state.view.y+state.view.h,state.format,state.view.h);
+  s = Map_Coord(plot->db2,state.view.y,state.view.y+state.view.h,state.format,state.view.h);
   Brng->setText(tr("%1").arg(s));
 
   clickToFocus();
@@ -2192,8 +3151,8 @@ void DotWindow::frameToView(double newZ)
 }
 
 void DotWindow::clickToFocus()
-{ char *s1 = Map_Coord(& (plot->db1->gdb),state.focus.x,-1,state.format,state.view.w);
-  char *s2 = Map_Coord(& (plot->db2->gdb),-1,state.focus.y,state.format,state.view.h);
+{ char *s1 = Map_Coord(plot->db1,state.focus.x,-1,state.format,state.view.w);
+  char *s2 = Map_Coord(plot->db2,-1,state.focus.y,state.format,state.view.h);
   Fpnt->setText(tr("%1,%2").arg(s1).arg(s2));
 }
 
@@ -2286,11 +3245,11 @@ void DotWindow::viewChange()
     { state.view = undo;
       DotWindow::warning(tr("Beyond maximal zoom of 1bp per pixel"),this,DotWindow::ERROR,tr("OK"));
 
-      s = Map_Coord(&(plot->db1->gdb),state.view.x,state.view.x+state.view.w,
+      s = Map_Coord(plot->db1,state.view.x,state.view.x+state.view.w,
                    state.format,state.view.w);
       Arng->setText(tr("%1").arg(s));
 
-      s = Map_Coord(&(plot->db2->gdb),state.view.y,state.view.y+state.view.h,
+      s = Map_Coord(plot->db2,state.view.y,state.view.y+state.view.h,
                     state.format,state.view.h);
       Brng->setText(tr("%1").arg(s));
     }
@@ -2332,6 +3291,21 @@ void DotWindow::thickChange(int index)
   update();
 }
 
+void DotWindow::dotCapChange(int index)
+{ state.dotCap = index;
+  update();
+}
+
+void DotWindow::dotMaskChange()
+{ state.dotMask = dotMaskBox->isChecked();
+  update();
+}
+
+void DotWindow::idVizChange()
+{ state.idViz = idVizBox->isChecked();
+  update();
+}
+
 void DotWindow::focusColorChange()
 { state.fColor = QColorDialog::getColor(state.fColor);
   focusBox->setDown(false);
@@ -2380,8 +3354,117 @@ void DotWindow::locatorColorChange()
 void DotWindow::addTextBox(AlignWindow *awin)
 { alignWindows += awin; }
 
+void DotWindow::removeTextBox(AlignWindow *awin)
+{ alignWindows.removeAll(awin); }
+
+//  Export the alignments of the top-most visible alignment layer in region to a file chosen
+//    by the user, showing progress in a modal dialog while threads compute them.
+
+void DotWindow::exportRegion(Frame *region)
+{ RegionExport *ex;
+  QString       filter;
+  int           j, k, format;
+  int64         n;
+
+  for (j = state.nlays-1; j >= 0; j--)
+    { k = state.order[j];
+      if (state.on[k] && k != 0)
+        break;
+    }
+  if (j < 0)
+    { DotWindow::warning(tr("No alignment layer is visible"),this,DotWindow::WARNING,tr("OK"));
+      return;
+    }
+
+  QString path = QFileDialog::getSaveFileName(this,tr("Export alignments in region"),
+                                              tr("region.paf"),
+                                              tr("PAF with CIGAR and cs tags (*.paf);;"
+                                                 "Alignment text (*.txt)"),&filter);
+  if (path.isEmpty())
+    return;
+  if (filter.startsWith(tr("PAF")))
+    format = EXPORT_PAF;
+  else
+    format = EXPORT_TEXT;
+
+  ex = New_Region_Export(plot,k,region,path.toLatin1().data(),format);
+  if (ex == NULL)
+    { DotWindow::warning(tr(EPLACE),this,DotWindow::ERROR,tr("OK"));
+      return;
+    }
+  n = Region_Export_Count(ex);
+
+  QProgressDialog progress(tr("Exporting %1 alignments ...").arg(n),tr("Cancel"),0,n,this);
+  progress.setWindowModality(Qt::ApplicationModal);
+  progress.setMinimumDuration(500);
+
+  ExportThread thread(ex,QThread::idealThreadCount());
+  thread.start();
+  while ( ! thread.wait(100))
+    { progress.setValue(thread.done);
+      if (progress.wasCanceled())
+        thread.cancel();
+    }
+  progress.reset();
+
+  if (thread.ok)
+    DotWindow::warning(tr("Exported %1 alignments to %2").arg(n).arg(path),
+                       this,DotWindow::INFORM,tr("OK"));
+  else if ( ! thread.error.isEmpty())
+    DotWindow::warning(thread.error,this,DotWindow::ERROR,tr("OK"));
+  else
+    DotWindow::warning(tr("Export cancelled, %1 was not written").arg(path),
+                       this,DotWindow::INFORM,tr("OK"));
+  Free_Region_Export(ex);
+}
+
+//  Show in the statistics panel the aggregate statistics of the alignments of layer in
+//    region (of the top-most visible alignment layer if layer is NULL) under title
+
+void DotWindow::showStats(Frame *region, DotLayer *layer, const QString &title)
+{ RegionStats stats;
+  char       *suf;
+  double      d;
+  int         j, k, prec;
+
+  k = -1;
+  for (j = state.nlays-1; j >= 0; j--)
+    { if (layer == NULL)
+        { if (state.on[state.order[j]] && state.order[j] != 0)
+            break;
+        }
+      else if (plot->layers[state.order[j]] == layer)
+        break;
+    }
+  if (j >= 0)
+    k = state.order[j];
+  if (k <= 0)
+    return;
+
+  Region_Stats(plot,k,region,&stats);
+
+  if (stats.abp <= 0.)
+    { statsPanel->setText(tr("<b>%1:</b><br>&nbsp;&nbsp;No alignments").arg(title));
+      return;
+    }
+
+  d = digits((int64) stats.abp,&suf,&prec);
+  statsPanel->setText(tr("%1<br>%2<br>%3<br>%4<br>%5")
+                        .arg(tr("<b>%1:</b>").arg(title))
+                        .arg(tr("&nbsp;&nbsp;%1 alignments start").arg(stats.nsegs))
+                        .arg(tr("&nbsp;&nbsp;%1%2bp aligned").arg(stats.abp/d,0,'f',prec).arg(suf))
+                        .arg(tr("&nbsp;&nbsp;Fwd %1% / Rev %2%")
+                                .arg(100.*stats.fbp/stats.abp,0,'f',0)
+                                .arg(100.*(stats.abp-stats.fbp)/stats.abp,0,'f',0))
+                        .arg(tr("&nbsp;&nbsp;Id mean %1%, median %2%3%")
+                                .arg(stats.mean,0,'f',1)
+                                .arg(stats.median < ID_LOW ? "<" : "")
+                                .arg(stats.median < ID_LOW ? ID_LOW : stats.median)));
+}
+
 void DotWindow::closeEvent(QCloseEvent *event)
-{ int i;
+{ AlignWindow *awin;
+  int          i;
 
   if (dotwindows.length() == 1)
     writeSettings();
@@ -2392,9 +3475,13 @@ void DotWindow::closeEvent(QCloseEvent *event)
         break;
       }
 
-  for (i = 0; i < this->alignWindows.length(); i++)
-    alignWindows[i]->close();
+  while (alignWindows.length() > 0)
+    { awin = alignWindows.takeFirst();
+      awin->stopAlign();
+      awin->close();
+    }
 
+  canvas->cancelDots();
   if (this->plot != NULL)
     Free_DotPlot(this->plot);
   this->plot = NULL;
@@ -2530,11 +3617,11 @@ void DotWindow::pushState()
 
   cFormat->setCurrentIndex(state.format);
 
-  s1 = Map_Coord(&(plot->db1->gdb),state.view.x,state.view.x+state.view.w,
+  s1 = Map_Coord(plot->db1,state.view.x,state.view.x+state.view.w,
                  state.format,state.view.w);
   Arng->setText(tr("%1").arg(s1));
 
-  s1 = Map_Coord(&(plot->db2->gdb),state.view.y,state.view.y+state.view.h,
+  s1 = Map_Coord(plot->db2,state.view.y,state.view.y+state.view.h,
                  state.format,state.view.h);
   Brng->setText(tr("%1").arg(s1));
 
@@ -2546,8 +3633,8 @@ void DotWindow::pushState()
   Fpnt->setEnabled(state.fOn);
   focusBox->setEnabled(state.fOn);
   focusCheck->setEnabled(state.fOn);
-  s1 = Map_Coord(& (plot->db2->gdb),state.focus.x,-1,state.format,state.view.w);
-  s2 = Map_Coord(& (plot->db2->gdb),-1,state.focus.y,state.format,state.view.h);
+  s1 = Map_Coord(plot->db2,state.focus.x,-1,state.format,state.view.w);
+  s2 = Map_Coord(plot->db2,-1,state.focus.y,state.format,state.view.h);
   Fpnt->setText(tr("%1,%2").arg(s1).arg(s2));
 
   QPixmap blob = QPixmap(16,16);
@@ -2575,6 +3662,9 @@ void DotWindow::pushState()
       layerRBox[j]->setIcon(QIcon(blob2));
       layerThick[j]->setCurrentIndex(state.thick[j]);
     }
+  dotCapBox->setCurrentIndex(state.dotCap);
+  dotMaskBox->setCheckState(state.dotMask?(Qt::Checked):(Qt::Unchecked));
+  idVizBox->setCheckState(state.idViz?(Qt::Checked):(Qt::Unchecked));
   activateLayer(0);
 
   lman = static_cast<QVBoxLayout *>(layerPanel->layout());
@@ -2617,8 +3707,14 @@ void DotWindow::readAndApplySettings()
         colR[j] = settings.value(tr("colR%1").arg(j), QColor(255,0,0).rgb()).toUInt();
         state.thick[j] = settings.value(tr("thick%1").arg(j), 1).toInt();
       }
+    state.dotCap  = settings.value("dotCap", 3).toInt();
+    state.dotMask = settings.value("dotMask", false).toBool();
+    state.idViz   = settings.value("idViz", false).toBool();
   settings.endGroup();
 
+  if (state.dotCap < 0 || state.dotCap >= NUM_DOT_CAPS)
+    state.dotCap = 3;
+
   state.fColor.setRgb(fRGB);
   state.lColor.setRgb(lRGB);
   for (j = 0; j < MAX_LAYERS; j++)
@@ -2668,6 +3764,9 @@ void DotWindow::writeSettings()
         settings.setValue(tr("colR%1").arg(j), state.colorR[j].rgb());
         settings.setValue(tr("thick%1").arg(j), state.thick[j]);
       }
+    settings.setValue("dotCap", state.dotCap);
+    settings.setValue("dotMask", state.dotMask);
+    settings.setValue("idViz", state.idViz);
   settings.endGroup();
 
   openDialog->writeSettings(settings);
@@ -8,6 +8,8 @@
 extern "C" {
 #include "GDB.h"
 #include "sticks.h"
+#include "doter.h"
+#include "prefetch.h"
 }
 
 class DotCanvas;
@@ -40,6 +42,10 @@ typedef struct
   QColor          colorF[MAX_LAYERS];
   QColor          colorR[MAX_LAYERS];
   int             thick[MAX_LAYERS];
+
+  int             dotCap;     //  index of k-mer occurrence cap for the dot plot layer
+  bool            dotMask;    //  exclude soft-masked sequence from the dot plot layer
+  bool            idViz;      //  color alignments by the identity of each trace point interval
   
   QColor          lColor;
   bool            lViz;
@@ -112,12 +118,67 @@ protected:
 };
 
 
+/***************************************************************************************/
+/*                                                                                     */
+/*   DOT PLOT WORKER                                                                   */
+/*                                                                                     */
+/***************************************************************************************/
+
+class DotJob : public QThread
+{
+  Q_OBJECT
+
+public:
+  DotJob(DotPlot *plot, View *view, int kmer, int cap, bool mask,
+         int rectW, int rectH, QColor color);
+  ~DotJob();
+
+  bool sameAs(View *view, int kmer, int cap, bool mask, int rectW, int rectH, QColor color);
+  void cancel();
+
+  QImage   *image;    //  result, NULL if cancelled or failed
+  View      view;     //  view and scale the image was computed for
+  double    xa, ya;
+  DotCounts counts;   //  # of hits and of k-mers suppressed by the cap
+
+protected:
+  void run();
+
+private:
+  DotPlot      *plot;
+  int           kmer;
+  int           cap;
+  bool          mask;
+  int           rectW;
+  int           rectH;
+  QColor        color;
+  volatile int  halt;
+};
+
+
 /***************************************************************************************/
 /*                                                                                     */
 /*   DOT CANVAS                                                                        */
 /*                                                                                     */
 /***************************************************************************************/
 
+  //  Key of a tile of a line layer rendered at a given scale and style (see main_window.cpp)
+
+typedef struct
+  { DotLayer *layer;
+    int64     xlev, ylev;   //  scales quantized on a log scale
+    int64     i, j;         //  tile position in the global pixel grid of the scale
+    QRgb      colorF;
+    QRgb      colorR;
+    int       thick;
+    int       idViz;
+    int       heat;         //  drawn as a density heat map
+    int       dpr;          //  device pixel ratio of the tile image in 1/100ths
+  } TileKey;
+
+bool   operator==(const TileKey &a, const TileKey &b);
+size_t qHash(const TileKey &key, size_t seed = 0);
+
 class DotCanvas : public QWidget
 {
   Q_OBJECT
@@ -130,12 +191,10 @@ public:
   bool   zoomView(double zoomDel);
   void   resetView();
   bool   viewToFrame();
+  void   cancelDots();
 
   static int labelWidth;
 
-  static QVector<QRgb> ctable;
-  static QVector<uchar> imbit;
-
 public slots:
   void zoomPop();
 
@@ -161,9 +220,15 @@ protected:
 
 private slots:
   void showAlign();
+  void dotsDone();
 
 private:
   DotSegment *pick(int x, int y, DotLayer **layer);
+  bool        selectedRegion(Frame *region);
+  void        layerPens(int k, QPen *fPen, QPen *rPen);
+  void        drawSegment(QPainter &painter, int k, DotSegment *line, QPen &fPen, QPen &rPen,
+                          double xa, double xb, double ya, double yb);
+  QImage     *layerTile(int k, int64 i, int64 j, double xa, double ya, bool heat);
   DotSegment *pickedSeg;
   DotLayer   *pickedLayer;
 
@@ -173,8 +238,14 @@ private:
   int          rectW;
   int          rectH;
 
-  QImage      *image;
-  uchar      **raster;
+  DotJob        *dotShown;    //  job whose image is currently painted for the k-mer layer
+  DotJob        *dotPending;  //  job computing the image for the current view
+  QList<DotJob *> dotJobs;    //  all jobs still running (including cancelled ones)
+  Prefetcher    *prefetch;    //  sequence read-ahead for the dot plot, NULL until needed
+  bool           noPrefetch;  //  New_Prefetcher failed for this plot, do not try again
+  QCache<TileKey,QImage> tiles;   //  rendered tiles of the line layers
+  QList<TileKey> partial;         //  tiles drawn with some local identity missing
+  int            traceReads;      //  trace reads left for the current paint, -1 if run out
 
   DotPlot     *plot;
   DotState    *state;
@@ -186,6 +257,7 @@ private:
 
   int          lastKey;
   bool         select;
+  bool         exporting;   //  region selected is to be exported, not zoomed to
   bool         nograb;
   bool         picking;
   int          menuLock;
@@ -230,15 +302,128 @@ private:
 /*                                                                                     */
 /***************************************************************************************/
 
+class AlignThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  AlignThread(AlignJob *job);
+  ~AlignThread();
+
+  void cancel();
+
+  AlignJob *job;
+  bool      done;     //  job computed, false if cancelled or failed
+  QString   error;    //  message if failed
+
+protected:
+  void run();
+
+private:
+  volatile int halt;
+};
+
+class ExportThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  ExportThread(RegionExport *ex, int nthreads);
+
+  void cancel();
+
+  RegionExport  *ex;
+  int            nthreads;
+  volatile int64 done;     //  # of alignments written so far
+  bool           ok;       //  export complete, false if cancelled or failed
+  QString        error;    //  message if failed
+
+protected:
+  void run();
+
+private:
+  volatile int halt;
+};
+
+class IndexThread : public QThread
+{
+  Q_OBJECT
+
+public:
+  IndexThread(DotPlot *plot, int nthreads);
+
+  void cancel();
+
+  DotPlot       *plot;
+  int            nthreads;
+  volatile int64 done;     //  # of bases indexed so far
+  bool           ok;       //  indices built, false if cancelled or failed
+  QString        error;    //  message if failed
+
+protected:
+  void run();
+
+private:
+  volatile int halt;
+};
+
+class AlignView : public QAbstractScrollArea
+{
+  Q_OBJECT
+
+public:
+  AlignView(QWidget *parent = 0);
+
+  void setJob(AlignJob *job);
+  void setMessage(const QString &message);
+
+protected:
+  void paintEvent(QPaintEvent *event);
+  void resizeEvent(QResizeEvent *event);
+  void mousePressEvent(QMouseEvent *event);
+  void mouseMoveEvent(QMouseEvent *event);
+
+private slots:
+  void copyRows();
+  void selectAll();
+
+private:
+  void  setRanges();
+  int64 rowAt(int y);
+
+  AlignJob *job;       //  alignment shown, or NULL if showing message
+  QString   message;
+  int       lineH;
+  int       lineW;
+  int64     selA;      //  rows selected are those between selA and selB inclusive,
+  int64     selB;      //    none if selA < 0
+
+  QAction  *copyAct;
+  QAction  *allAct;
+};
+
 class AlignWindow : public QMainWindow
 {
   Q_OBJECT
 
 public:
-  AlignWindow(QString title, char *atext, QWidget *parent = NULL, Qt::WindowFlags flags = Qt::WindowFlags());
+  AlignWindow(AlignJob *job, QWidget *parent = NULL, Qt::WindowFlags flags = Qt::WindowFlags());
+  ~AlignWindow();
+
+  void stopAlign();
+
+protected:
+  void closeEvent(QCloseEvent *event);
+
+private slots:
+  void cancelAlign();
+  void alignDone();
 
 private:
-  QTextEdit *edit;
+  AlignThread  *thread;
+  AlignView    *view;
+  QProgressBar *progress;
+  QPushButton  *cancelButton;
 };
 
 
@@ -283,6 +468,9 @@ public slots:
 
   void formatChange(int index);
   void thickChange(int index);
+  void dotCapChange(int index);
+  void dotMaskChange();
+  void idVizChange();
  
   void focusOnChange();
   void focusChange();
@@ -294,6 +482,8 @@ public slots:
 
   void openOverlay();
   void openCopy();
+  void buildIndex();
+  void cacheStats();
   void closeAll();
 
   void toggleToolBar();
@@ -307,6 +497,9 @@ public slots:
   void seqMove(int,int);
 
    void addTextBox(AlignWindow *align);
+   void removeTextBox(AlignWindow *align);
+  void exportRegion(Frame *region);
+  void showStats(Frame *region, DotLayer *layer, const QString &title);
 
 protected:
   void closeEvent(QCloseEvent *event);
@@ -339,6 +532,8 @@ private:
   QAction *openAct;
   QAction *overAct;
   QAction *copyAct;
+  QAction *indexAct;
+  QAction *cacheAct;
   QAction *toolAct;
 
   QAction *tileAct;
@@ -374,11 +569,16 @@ private:
     QToolButton *layerRBox[MAX_LAYERS];
     QLabel      *layerRText[MAX_LAYERS];
     QComboBox   *layerThick[MAX_LAYERS];
+    QComboBox   *dotCapBox;
+    QCheckBox   *dotMaskBox;
+    QCheckBox   *idVizBox;
 
   QToolButton        *locatorBox;
   QCheckBox          *locatorCheck;
   QButtonGroup       *locatorQuad;
 
+  QLabel             *statsPanel;
+
   QList<AlignWindow *> alignWindows;
 };
 
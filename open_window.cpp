@@ -71,6 +71,14 @@ void OpenDialog::openALN()
     }
 }
 
+void OpenDialog::openCache()
+{ QString dir;
+
+  dir = QFileDialog::getExistingDirectory(this,tr("GDB cache folder"),cDir->text());
+  if ( ! dir.isNull())
+    cDir->setText(dir);
+}
+
 void OpenDialog::activateLongest(int state)
 { bool on;
 
@@ -117,6 +125,16 @@ void OpenDialog::activateSize(int state)
     }
 }
 
+void OpenDialog::activateCache(int state)
+{ bool on;
+
+  on = (state == Qt::Checked);
+
+  cLabel->setEnabled(on);
+  cDir->setEnabled(on);
+  cSelect->setEnabled(on);
+}
+
 void OpenDialog::aboutTo()
 { QString    dir;
   QFileInfo *ninfo;
@@ -191,6 +209,19 @@ void OpenDialog::aboutTo()
   else
     sCut = -1;
 
+  if (cBox->isChecked())
+    { if (cDir->text().isEmpty())
+        { DotWindow::warning(tr("GDB cache folder not specified"),
+                     this,DotWindow::ERROR,tr("OK"));
+          return;
+        }
+      if ( ! QFileInfo(cDir->text()).isDir())
+        { DotWindow::warning(tr("GDB cache folder ")+cDir->text()+tr(" is not a directory"),
+                     this,DotWindow::ERROR,tr("OK"));
+          return;
+        }
+    }
+
   accept();
 }
 
@@ -237,6 +268,15 @@ OpenDialog::OpenDialog(QWidget *parent) : QDialog(parent)
     sLabel->setEnabled(false);
     sCutoff->setEnabled(false);
 
+  cLabel  = new QLabel(tr("Keep GDBs of FASTA sources in"));
+  cDir    = new QLineEdit();
+  cSelect = new QPushButton("Pick");
+  cBox = new QCheckBox();
+    cBox->setCheckState(Qt::Unchecked);
+    cLabel->setEnabled(false);
+    cDir->setEnabled(false);
+    cSelect->setEnabled(false);
+
   QHBoxLayout *file = new QHBoxLayout();
     file->addWidget(alnLabel);
     file->addWidget(alnFile,1);
@@ -264,12 +304,20 @@ OpenDialog::OpenDialog(QWidget *parent) : QDialog(parent)
     size->addWidget(sLabel);
     size->addStretch(1);
 
+  QHBoxLayout *cache = new QHBoxLayout();
+    cache->addWidget(cBox);
+    cache->addWidget(cLabel);
+    cache->addWidget(cDir,1);
+    cache->addWidget(cSelect);
+
   QVBoxLayout *select = new QVBoxLayout();
     select->addLayout(file);
     select->addSpacing(5);
     select->addLayout(leng);
     select->addLayout(id);
     select->addLayout(size);
+    select->addSpacing(5);
+    select->addLayout(cache);
 
   cancel = new QPushButton("Cancel");
   open = new QPushButton("Open");
@@ -303,6 +351,9 @@ OpenDialog::OpenDialog(QWidget *parent) : QDialog(parent)
   connect(lBox,SIGNAL(stateChanged(int)),this,SLOT(activateLongest(int)));
   connect(iBox,SIGNAL(stateChanged(int)),this,SLOT(activateIdentity(int)));
   connect(sBox,SIGNAL(stateChanged(int)),this,SLOT(activateSize(int)));
+
+  connect(cSelect,SIGNAL(clicked()),this,SLOT(openCache()));
+  connect(cBox,SIGNAL(stateChanged(int)),this,SLOT(activateCache(int)));
 }
 
 void OpenDialog::getState(Open_State &state)
@@ -314,6 +365,8 @@ void OpenDialog::getState(Open_State &state)
   state.idCut         = iCut;
   state.sizeOn        = sBox->isChecked();
   state.sizeCut       = sCut;
+  state.cacheOn       = cBox->isChecked();
+  state.cacheDir      = cDir->text();
 }
 
 void OpenDialog::putState(Open_State &state)
@@ -345,6 +398,13 @@ void OpenDialog::putState(Open_State &state)
   else
     activateSize(Qt::Unchecked);
   sBox->setChecked(state.sizeOn);
+
+  cDir->setText(state.cacheDir);
+  if (state.cacheOn)
+    activateCache(Qt::Checked);
+  else
+    activateCache(Qt::Unchecked);
+  cBox->setChecked(state.cacheOn);
 }
 
 void OpenDialog::readAndApplySettings()
@@ -361,6 +421,8 @@ void OpenDialog::readAndApplySettings()
     state.idOn     = settings.value("idOn",false).toBool();
     state.sizeCut  = settings.value("sizeCut",-1).toInt();
     state.sizeOn   = settings.value("sizeOn",false).toBool();
+    state.cacheOn  = settings.value("cacheOn",false).toBool();
+    state.cacheDir = settings.value("cacheDir",tr("")).toString();
   settings.endGroup();
 
   if (filepath.isEmpty())
@@ -391,5 +453,7 @@ void OpenDialog::writeSettings(QSettings &settings)
     settings.setValue("longOn", state.longOn);
     settings.setValue(  "idOn", state.idOn);
     settings.setValue("sizeOn", state.sizeOn);
+    settings.setValue("cacheOn", state.cacheOn);
+    settings.setValue("cacheDir", state.cacheDir);
   settings.endGroup();
 }
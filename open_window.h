@@ -43,6 +43,8 @@ typedef struct
     int        idCut;
     bool       sizeOn;
     int        sizeCut;
+    bool       cacheOn;
+    QString    cacheDir;
   } Open_State;
 
 class OpenDialog : public QDialog
@@ -62,8 +64,10 @@ private slots:
   void activateLongest(int);
   void activateIdentity(int);
   void activateSize(int);
+  void activateCache(int);
 
   void openALN();
+  void openCache();
   void aboutTo();
 
 private:
@@ -80,6 +84,11 @@ private:
     QLineEdit   *sCutoff;
     QLabel      *sLabel;
 
+  QCheckBox   *cBox;
+    QLabel      *cLabel;
+    QLineEdit   *cDir;
+    QPushButton *cSelect;
+
   QPushButton *open;
   QPushButton *cancel;
 
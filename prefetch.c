@@ -0,0 +1,176 @@
+/*******************************************************************************************
+ *
+ *  Sequence read-ahead around the current view of a dot plot (see prefetch.h)
+ *
+ *  The thread sleeps until a view is requested and then reads ahead, in order, the view,
+ *    the window one view-width ahead in the direction of the last pan, and the window one
+ *    view-width behind, alternating between the two genomes.  A newer request or a stop
+ *    abandons the read-ahead in progress at the next contig or every PAGE_BATCH pages.
+ *
+ *******************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "doter.h"
+#include "prefetch.h"
+
+#define PAGE_BATCH 256
+
+static int stale(Prefetcher *pf)
+{ return (pf->pending || pf->quit); }
+
+//  Read ahead the .bps bytes of global interval [beg,end) of db whose total length is glen
+
+static void read_ahead(Prefetcher *pf, DotGDB *db, int64 glen, int64 beg, int64 end)
+{ GDB        *gdb = &(db->gdb);
+  GDB_CONTIG *ctg = gdb->contigs;
+  int64       page;
+  int64       cb, cf, off, bend, p;
+  int         c, ce;
+  uint8      *m;
+
+  volatile uint8 sink;
+
+  if (gdb->seqs == NULL || (gdb->seqstate == COMPRESSED && gdb->seqmap == 0))
+    return;                  //  no sequence or it is already all in memory
+
+  if (beg < 0)
+    beg = 0;
+  if (end > glen)
+    end = glen;
+  if (beg >= end)
+    return;
+
+  page = sysconf(_SC_PAGESIZE);
+
+  ce = Coord_Contig(db->coords,end-1);
+  for (c = Coord_Contig(db->coords,beg); c <= ce; c++)
+    { if (stale(pf))
+        break;
+
+      cb = beg - ctg[c].sbeg;
+      if (cb < 0)
+        cb = 0;
+      cf = end - ctg[c].sbeg;
+      if (cf > ctg[c].clen)
+        cf = ctg[c].clen;
+      if (cf <= cb)
+        continue;
+
+      off  = ctg[c].boff + cb/4;
+      bend = ctg[c].boff + (cf-1)/4 + 1;
+
+      if (gdb->seqstate == EXTERNAL)
+        { posix_fadvise(fileno((FILE *) gdb->seqs),off,bend-off,POSIX_FADV_WILLNEED);
+          continue;
+        }
+
+      m    = (uint8 *) gdb->seqs;
+      off -= off % page;
+      madvise(m+off,bend-off,MADV_WILLNEED);
+      for (p = off; p < bend; p += page)
+        { if ((p-off) % (PAGE_BATCH*page) == 0 && stale(pf))
+            return;
+          sink = m[p];
+        }
+    }
+
+  (void) sink;
+}
+
+static void *prefetcher(void *arg)
+{ Prefetcher *pf   = (Prefetcher *) arg;
+  DotPlot    *plot = pf->plot;
+  View        v;
+  int64       sa, sb, ax, by;
+  int         k, s;
+
+  while (1)
+    { pthread_mutex_lock(&(pf->mutex));
+      while ( ! pf->pending && ! pf->quit)
+        pthread_cond_wait(&(pf->cond),&(pf->mutex));
+      if (pf->quit)
+        { pthread_mutex_unlock(&(pf->mutex));
+          break;
+        }
+      v  = pf->view;
+      sa = (pf->dx < 0) ? -1 : 1;
+      sb = (pf->dy < 0) ? -1 : 1;
+      pf->pending = 0;
+      pthread_mutex_unlock(&(pf->mutex));
+
+      for (k = 0; k < 3; k++)          //  the view, the window ahead, the window behind
+        { s  = (k == 0) ? 0 : ((k == 1) ? 1 : -1);
+          ax = v.x + s*sa*v.w;
+          by = v.y + s*sb*v.h;
+          read_ahead(pf,plot->db1,plot->alen,ax,ax+v.w);
+          read_ahead(pf,plot->db2,plot->blen,by,by+v.h);
+          if (stale(pf))
+            break;
+        }
+    }
+
+  return (NULL);
+}
+
+Prefetcher *New_Prefetcher(DotPlot *plot)
+{ Prefetcher *pf;
+
+  pf = (Prefetcher *) Malloc(sizeof(Prefetcher),"Allocating prefetcher");
+  if (pf == NULL)
+    EXIT(NULL);
+
+  pf->plot    = plot;
+  pf->quit    = 0;
+  pf->pending = 0;
+  pf->view.x  = pf->view.y = -1;
+  pf->view.w  = pf->view.h = 0;
+  pf->dx      = pf->dy = 0;
+  pthread_mutex_init(&(pf->mutex),NULL);
+  pthread_cond_init(&(pf->cond),NULL);
+
+  if (pthread_create(&(pf->thread),NULL,prefetcher,pf) != 0)
+    { EPRINTF(EPLACE,"%s: Could not start read-ahead thread\n",Prog_Name);
+      pthread_cond_destroy(&(pf->cond));
+      pthread_mutex_destroy(&(pf->mutex));
+      free(pf);
+      EXIT(NULL);
+    }
+  return (pf);
+}
+
+void Free_Prefetcher(Prefetcher *pf)
+{ if (pf == NULL)
+    return;
+  pthread_mutex_lock(&(pf->mutex));
+  pf->quit = 1;
+  pthread_cond_signal(&(pf->cond));
+  pthread_mutex_unlock(&(pf->mutex));
+  pthread_join(pf->thread,NULL);
+  pthread_cond_destroy(&(pf->cond));
+  pthread_mutex_destroy(&(pf->mutex));
+  free(pf);
+}
+
+void Prefetch_View(Prefetcher *pf, View *view)
+{ if (view->w > MAX_DOTPLOT || view->h > MAX_DOTPLOT)
+    return;
+
+  pthread_mutex_lock(&(pf->mutex));
+  if (view->x != pf->view.x || view->y != pf->view.y ||
+      view->w != pf->view.w || view->h != pf->view.h)
+    { if (pf->view.w > 0)
+        { pf->dx = view->x - pf->view.x;
+          pf->dy = view->y - pf->view.y;
+        }
+      pf->view    = *view;
+      pf->pending = 1;
+      pthread_cond_signal(&(pf->cond));
+    }
+  pthread_mutex_unlock(&(pf->mutex));
+}
@@ -0,0 +1,47 @@
+/*****************************************************************************************\
+*                                                                                         *
+*  Sequence read-ahead around the current view of a dot plot                              *
+*                                                                                         *
+*  A background thread brings the 2-bit sequence that the k-mer dot plot layer will need  *
+*  into memory before it is asked for: first that of the view itself, then that of the    *
+*  adjacent windows of both genomes in the direction of the last pan, then those behind.  *
+*  The pages of a memory mapped .bps file are advised and touched, and those of a .bps    *
+*  file read by stdio are advised to the kernel, so that slow (e.g. network mounted)      *
+*  storage is read off the interactive path.                                              *
+*                                                                                         *
+\*****************************************************************************************/
+
+#ifndef _PREFETCH
+#define _PREFETCH
+
+#include <pthread.h>
+
+#include "gene_core.h"
+#include "sticks.h"
+
+typedef struct
+  { DotPlot         *plot;
+    pthread_t        thread;
+    pthread_mutex_t  mutex;     //  guards the fields below
+    pthread_cond_t   cond;
+    volatile int     quit;      //  set to stop the thread
+    volatile int     pending;   //  a request not yet taken up by the thread
+    View             view;      //  the view last requested
+    int64            dx, dy;    //  its displacement from the view requested before it
+  } Prefetcher;
+
+  //  Start a read-ahead thread for plot.  Returns NULL with a message in EPLACE on failure.
+
+Prefetcher *New_Prefetcher(DotPlot *plot);
+
+  //  Stop the thread (abandoning any read-ahead in progress) and free pf
+
+void Free_Prefetcher(Prefetcher *pf);
+
+  //  Ask for read-ahead around view, which is ignored if it is the view last requested or
+  //    is too large for the dot plot to read sequence for.  Returns immediately; a read-ahead
+  //    in progress is abandoned in favor of the new one.
+
+void Prefetch_View(Prefetcher *pf, View *view);
+
+#endif // _PREFETCH
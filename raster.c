@@ -0,0 +1,319 @@
+/*******************************************************************************************
+ *
+ *  Software rasterizer for the segments of the line layers (see raster.h)
+ *
+ *  A line is stepped along its major axis one pixel at a time.  At each step the line,
+ *    width pixels thick, covers an interval of the minor axis, and each pixel it overlaps
+ *    is blended with the line's color by the length of that overlap times the fraction of
+ *    the step the line spans (less than 1 only at its ends), a box-filtered Wu line.
+ *
+ *  A heat map line gives each of the pixels it steps through a rounded share of its bp
+ *    such that the shares of all its steps, whether in the image or not, sum to its bp.
+ *
+ *******************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "raster.h"
+
+typedef struct
+  { RasterLine *lines;
+    int         n;
+    double      width;
+    uint32     *image;
+    int         w;
+    int64       stride;
+    int         rbeg;     //  rows [rbeg,rend) of the image belong to this band
+    int         rend;
+  } LineBand;
+
+//  Blend premultiplied color s with coverage k (in [0,256]) over d
+
+static inline uint32 blend(uint32 d, uint32 s, int k)
+{ uint32 rb, ag, inv;
+
+  s   = ((((s & 0x00ff00ff) * k) >> 8) & 0x00ff00ff) | ((((s >> 8) & 0x00ff00ff) * k) & 0xff00ff00);
+  inv = 255 - (s >> 24);
+  rb  = (d & 0x00ff00ff) * inv + 0x00800080;
+  rb  = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+  ag  = ((d >> 8) & 0x00ff00ff) * inv + 0x00800080;
+  ag  = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+  return (s + rb + ag);
+}
+
+#define PIXEL(b,c,r)  (((uint32 *) (((uint8 *) (b)->image) + (r)*(b)->stride)) + (c))
+
+//  Draw the part in band b of the line from (u0,v0) to (u1,v1), u0 <= u1, stepping along u
+//    with slope |dv/du| <= 1.  If xmaj is set then u is x and v is y, otherwise the reverse.
+
+static void stroke(LineBand *b, double u0, double v0, double u1, double v1, int xmaj, uint32 color)
+{ double slope, hw, mid, um, vc, vlo, vhi, ucov, cov;
+  double lo, hi, t;
+  int    ub, ue, ulim, vb, ve, vlim;
+  int    u, v, k;
+
+  if (u1 - u0 < 1.)
+    { mid = (u0+u1)/2.;
+      slope = (u1 > u0) ? (v1-v0)/(u1-u0) : 0.;
+      v0 = (v0+v1)/2. - slope/2.;
+      v1 = v0 + slope;
+      u0 = mid - .5;
+      u1 = mid + .5;
+    }
+  slope = (v1-v0)/(u1-u0);
+  hw    = .5 * b->width * sqrt(1.+slope*slope);
+
+  if (xmaj)
+    { ulim = b->w;
+      vb   = b->rbeg;
+      vlim = b->rend;
+    }
+  else
+    { ulim = b->rend;
+      vb   = 0;
+      vlim = b->w;
+    }
+
+  ub = (int) floor(u0);
+  ue = (int) floor(u1);
+  if (ub < 0)
+    ub = 0;
+  if (ue >= ulim)
+    ue = ulim-1;
+  if ( ! xmaj && ub < b->rbeg)
+    ub = b->rbeg;
+
+  //  Restrict an x-major line to the columns where it can reach the band
+
+  if (xmaj && slope != 0.)
+    { lo = u0 + ((b->rbeg - hw - 1.) - v0) / slope;
+      hi = u0 + ((b->rend + hw + 1.) - v0) / slope;
+      if (lo > hi)
+        { t = lo; lo = hi; hi = t; }
+      if (lo > ub)
+        ub = (lo > ue+1) ? ue+1 : (int) floor(lo);
+      if (hi < ue)
+        ue = (hi < ub-1) ? ub-1 : (int) floor(hi);
+    }
+
+  for (u = ub; u <= ue; u++)
+    { ucov = ((u+1 < u1) ? u+1 : u1) - ((u > u0) ? u : u0);
+      if (ucov <= 0.)
+        continue;
+      um  = u + .5;
+      if (um < u0)
+        um = u0;
+      if (um > u1)
+        um = u1;
+      vc  = v0 + (um-u0)*slope;
+      vlo = vc - hw;
+      vhi = vc + hw;
+      v  = (int) floor(vlo);
+      ve = (int) floor(vhi);
+      if (v < vb)
+        v = vb;
+      if (ve >= vlim)
+        ve = vlim-1;
+      for ( ; v <= ve; v++)
+        { cov = ((v+1 < vhi) ? v+1 : vhi) - ((v > vlo) ? v : vlo);
+          if (cov > 1.)
+            cov = 1.;
+          k = (int) (ucov*cov*256. + .5);
+          if (k <= 0)
+            continue;
+          if (xmaj)
+            *PIXEL(b,u,v) = blend(*PIXEL(b,u,v),color,k);
+          else
+            *PIXEL(b,v,u) = blend(*PIXEL(b,v,u),color,k);
+        }
+    }
+}
+
+static void *band_lines(void *arg)
+{ LineBand   *b = (LineBand *) arg;
+  RasterLine *l;
+  double      hw;
+  int         i;
+
+  hw = b->width/2. + 1.;
+  for (i = 0; i < b->n; i++)
+    { l = b->lines + i;
+      if ((l->y0 < b->rbeg - hw && l->y1 < b->rbeg - hw) ||
+          (l->y0 >= b->rend + hw && l->y1 >= b->rend + hw))
+        continue;
+      if (fabs(l->x1 - l->x0) >= fabs(l->y1 - l->y0))
+        { if (l->x0 <= l->x1)
+            stroke(b,l->x0,l->y0,l->x1,l->y1,1,l->color);
+          else
+            stroke(b,l->x1,l->y1,l->x0,l->y0,1,l->color);
+        }
+      else
+        { if (l->y0 <= l->y1)
+            stroke(b,l->y0,l->x0,l->y1,l->x1,0,l->color);
+          else
+            stroke(b,l->y1,l->x1,l->y0,l->x0,0,l->color);
+        }
+    }
+  return (NULL);
+}
+
+void raster_lines(RasterLine *lines, int n, double width,
+                  uint32 *image, int w, int h, int64 stride, int nthreads)
+{ int i;
+
+  if (nthreads > h)
+    nthreads = h;
+  if (nthreads < 1)
+    nthreads = 1;
+
+  { LineBand  parm[nthreads];
+    pthread_t threads[nthreads];
+    int       started[nthreads];
+
+    for (i = 0; i < nthreads; i++)
+      { parm[i].lines  = lines;
+        parm[i].n      = n;
+        parm[i].width  = width;
+        parm[i].image  = image;
+        parm[i].w      = w;
+        parm[i].stride = stride;
+        parm[i].rbeg   = (((int64) h)*i)/nthreads;
+        parm[i].rend   = (((int64) h)*(i+1))/nthreads;
+      }
+
+    //  A band whose thread cannot be started is drawn by this thread
+
+    for (i = 1; i < nthreads; i++)
+      started[i] = (pthread_create(threads+i,NULL,band_lines,parm+i) == 0);
+    band_lines(parm);
+    for (i = 1; i < nthreads; i++)
+      if (started[i])
+        pthread_join(threads[i],NULL);
+      else
+        band_lines(parm+i);
+  }
+}
+
+/*******************************************************************************************
+ *
+ *  DENSITY HEAT MAPS
+ *
+ *******************************************************************************************/
+
+#define HEAT_FLOOR  64   //  opacity (of 255) of a pixel with the least bp
+
+void heat_line(uint32 *heat, int w, int h, double x0, double y0, double x1, double y1, int64 bp)
+{ double dx, dy, t0, t1, p, q, r, share;
+  int64  steps, s, sb, se, a, c;
+  uint32 *cell;
+  int    i, x, y;
+
+  dx = x1-x0;
+  dy = y1-y0;
+
+  //  Clip the line to the image, [t0,t1] being the part of it within
+
+  t0 = 0.;
+  t1 = 1.;
+  for (i = 0; i < 4; i++)
+    { switch (i)
+      { case 0: p = -dx; q = x0;     break;
+        case 1: p =  dx; q = w-x0;   break;
+        case 2: p = -dy; q = y0;     break;
+        default: p = dy; q = h-y0;   break;
+      }
+      if (p == 0.)
+        { if (q < 0.)
+            return;
+          continue;
+        }
+      r = q/p;
+      if (p < 0.)
+        { if (r > t1)
+            return;
+          if (r > t0)
+            t0 = r;
+        }
+      else
+        { if (r < t0)
+            return;
+          if (r < t1)
+            t1 = r;
+        }
+    }
+
+  steps = (int64) ceil(fmax(fabs(dx),fabs(dy)));
+  if (steps < 1)
+    steps = 1;
+  share = ((double) bp) / steps;
+
+  sb = (int64) floor(t0*steps);
+  se = (int64) ceil(t1*steps);
+  if (se > steps)
+    se = steps;
+  for (s = sb; s < se; s++)
+    { r = (s+.5)/steps;
+      x = (int) floor(x0 + r*dx);
+      y = (int) floor(y0 + r*dy);
+      if (x < 0 || x >= w || y < 0 || y >= h)
+        continue;
+      a = llround((s+1)*share) - llround(s*share);
+      if (a <= 0)
+        continue;
+      cell = heat + ((int64) y)*w + x;
+      c    = *cell + a;
+      *cell = (c > 0xffffffffll) ? 0xffffffffu : (uint32) c;
+    }
+}
+
+static void tone_lut(uint32 color, uint32 *lut)
+{ int a, l, k;
+
+  a = (color >> 24);
+  for (l = 0; l < 256; l++)
+    { k = (HEAT_FLOOR + ((255-HEAT_FLOOR)*l)/255) * a / 255;
+      lut[l] = (((uint32) k) << 24)
+             | ((((color >> 16) & 0xff) * k / 255) << 16)
+             | ((((color >> 8) & 0xff) * k / 255) << 8)
+             | ((color & 0xff) * k / 255);
+    }
+}
+
+void heat_tone(uint32 *fheat, uint32 *rheat, int w, int h, double sat,
+               uint32 fcolor, uint32 rcolor, uint32 *image, int64 stride)
+{ uint32  flut[256], rlut[256];
+  uint32  f, r, fc, rc, c, *row;
+  double  norm, sum, wf;
+  int     x, y, l, sh;
+
+  tone_lut(fcolor,flut);
+  tone_lut(rcolor,rlut);
+
+  if (sat < 1.)
+    sat = 1.;
+  norm = 255. / log1p(sat);
+
+  for (y = 0; y < h; y++)
+    { row = (uint32 *) (((uint8 *) image) + y*stride);
+      for (x = 0; x < w; x++)
+        { f = fheat[((int64) y)*w + x];
+          r = rheat[((int64) y)*w + x];
+          if (f == 0 && r == 0)
+            continue;
+          sum = ((double) f) + r;
+          l   = (int) (log1p(sum)*norm);
+          if (l > 255)
+            l = 255;
+          fc = flut[l];
+          rc = rlut[l];
+          wf = f / sum;
+          c  = 0;
+          for (sh = 0; sh < 32; sh += 8)
+            c |= ((uint32) (((fc >> sh) & 0xff)*wf + ((rc >> sh) & 0xff)*(1.-wf) + .5)) << sh;
+          row[x] = blend(row[x],c,256);
+        }
+    }
+}
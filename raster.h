@@ -0,0 +1,47 @@
+/*****************************************************************************************\
+*                                                                                         *
+*  Software rasterizer for the segments of the line layers                                *
+*                                                                                         *
+*  Antialiased lines of a given width are drawn straight into a premultiplied ARGB image  *
+*  without any per-line QPainter overhead.  The rows of the image are split into bands,   *
+*  one per thread, and every thread draws the part of each line that falls in its band,   *
+*  so no two threads ever write the same pixel and the image is then blitted as a whole.  *
+*  When there are more lines than can be told apart, the aligned bp of each strand is     *
+*  instead accumulated per pixel and the sums tone-mapped into a heat map.                *
+*                                                                                         *
+\*****************************************************************************************/
+
+#ifndef _RASTER
+#define _RASTER
+
+#include "gene_core.h"
+
+typedef struct
+  { float  x0, y0;    //  end points in pixels, pixel (i,j) covering [i,i+1) x [j,j+1)
+    float  x1, y1;
+    uint32 color;     //  premultiplied ARGB
+  } RasterLine;
+
+  //  Draw the n lines in order (later ones over earlier ones), each width pixels wide, over
+  //    the w x h premultiplied ARGB image whose rows are stride bytes apart, with nthreads
+  //    threads.  A line shorter than a pixel is drawn a pixel long so that it is still seen.
+  //    The band of a thread that cannot be started is drawn by the calling thread.
+
+void raster_lines(RasterLine *lines, int n, double width,
+                  uint32 *image, int w, int h, int64 stride, int nthreads);
+
+  //  Density heat maps: heat is a w x h array of aligned bp per pixel of one strand.
+  //    Add to heat the bp of a line from (x0,y0) to (x1,y1) spread evenly over the pixels
+  //    it steps through along its major axis, saturating at the largest uint32.
+
+void heat_line(uint32 *heat, int w, int h, double x0, double y0, double x1, double y1, int64 bp);
+
+  //  Tone-map the forward and reverse heat maps fheat and rheat into the w x h premultiplied
+  //    ARGB image whose rows are stride bytes apart.  A pixel's opacity grows with the log of
+  //    its total bp, full at sat bp, and its color is that of fcolor and rcolor (unpremultiplied
+  //    ARGB) mixed by the share of each strand.  Pixels with no bp are left untouched.
+
+void heat_tone(uint32 *fheat, uint32 *rheat, int w, int h, double sat,
+               uint32 fcolor, uint32 rcolor, uint32 *image, int64 stride);
+
+#endif // _RASTER
@@ -0,0 +1,217 @@
+/*******************************************************************************************
+ *
+ *  LRU cache of decoded sequence chunks for a GDB (see seqcache.h)
+ *
+ *  The chunks in use are in a chained hash table on their key and in a doubly linked list
+ *    in order of last use.  When all chunks are in use the least recently used is recycled.
+ *
+ *******************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "seqcache.h"
+
+#define CHUNK_KEY(i,k)  ((((int64) (i)) << 32) | (k))
+
+static int hash_key(SeqCache *cache, int64 key)
+{ uint64 h = (uint64) key;
+
+  h ^= (h >> 29);
+  h *= 0x9e3779b97f4a7c15llu;
+  return ((int) (h >> 32) & cache->tmask);
+}
+
+SeqCache *New_Seq_Cache(GDB *gdb, pthread_mutex_t *lock, int64 memory)
+{ SeqCache *cache;
+  int       i, tlen;
+
+  cache = (SeqCache *) Malloc(sizeof(SeqCache),"Allocating sequence cache");
+  if (cache == NULL)
+    EXIT(NULL);
+
+  cache->nchunk = memory / SEQ_CHUNK;
+  if (cache->nchunk < 2)
+    cache->nchunk = 2;
+  for (tlen = 1; tlen < 2*cache->nchunk; tlen <<= 1)
+    ;
+
+  cache->chunks = (SeqChunk *) Malloc(sizeof(SeqChunk)*cache->nchunk,"Allocating sequence cache");
+  cache->table  = (SeqChunk **) Malloc(sizeof(SeqChunk *)*tlen,"Allocating sequence cache");
+  if (cache->chunks == NULL || cache->table == NULL)
+    { free(cache->table);
+      free(cache->chunks);
+      free(cache);
+      EXIT(NULL);
+    }
+
+  for (i = 0; i < cache->nchunk; i++)
+    { cache->chunks[i].key = -1;
+      cache->chunks[i].seq = NULL;
+    }
+  for (i = 0; i < tlen; i++)
+    cache->table[i] = NULL;
+
+  cache->gdb   = gdb;
+  cache->lock  = lock;
+  cache->tmask = tlen-1;
+  cache->nused = 0;
+  cache->head  = NULL;
+  cache->tail  = NULL;
+  cache->nhit  = 0;
+  cache->nmiss = 0;
+  pthread_mutex_init(&(cache->mutex),NULL);
+
+  return (cache);
+}
+
+void Free_Seq_Cache(SeqCache *cache)
+{ int i;
+
+  if (cache == NULL)
+    return;
+  for (i = 0; i < cache->nused; i++)
+    free(cache->chunks[i].seq-1);
+  pthread_mutex_destroy(&(cache->mutex));
+  free(cache->table);
+  free(cache->chunks);
+  free(cache);
+}
+
+  //  Move chunk c to the head of the LRU list (c is not in the list if it is new)
+
+static void make_recent(SeqCache *cache, SeqChunk *c, int inlist)
+{ if (inlist)
+    { if (cache->head == c)
+        return;
+      c->newer->older = c->older;
+      if (c->older == NULL)
+        cache->tail = c->newer;
+      else
+        c->older->newer = c->newer;
+    }
+  c->newer = NULL;
+  c->older = cache->head;
+  if (cache->head == NULL)
+    cache->tail = c;
+  else
+    cache->head->newer = c;
+  cache->head = c;
+}
+
+  //  Return the chunk for the k'th chunk of contig i, decoding it into a new or the least
+  //    recently used chunk if it is not in the cache.  The cache mutex must be held.
+
+static SeqChunk *get_chunk(SeqCache *cache, int i, int k)
+{ GDB      *gdb = cache->gdb;
+  int64     key = CHUNK_KEY(i,k);
+  SeqChunk *c, **p;
+  int       h, beg, end, new;
+  char     *s;
+
+  h = hash_key(cache,key);
+  for (c = cache->table[h]; c != NULL; c = c->next)
+    if (c->key == key)
+      { cache->nhit += 1;
+        make_recent(cache,c,1);
+        return (c);
+      }
+  cache->nmiss += 1;
+
+  new = (cache->nused < cache->nchunk);
+  if (new)
+    { c = cache->chunks + cache->nused;
+      s = (char *) Malloc(SEQ_CHUNK+2,"Allocating sequence cache chunk");
+      if (s == NULL)
+        EXIT(NULL);
+      c->seq = s+1;
+    }
+  else
+    { c = cache->tail;
+      if (c->key >= 0)
+        { for (p = cache->table + hash_key(cache,c->key); *p != c; p = &((*p)->next))
+            ;
+          *p = c->next;
+          c->key = -1;
+        }
+    }
+
+  beg = k*SEQ_CHUNK;
+  end = beg+SEQ_CHUNK;
+  if (end > gdb->contigs[i].clen)
+    end = gdb->contigs[i].clen;
+
+  if (cache->lock != NULL)
+    pthread_mutex_lock(cache->lock);
+  s = Get_Contig_Piece(gdb,i,beg,end,NUMERIC,c->seq);
+  if (cache->lock != NULL)
+    pthread_mutex_unlock(cache->lock);
+
+  if (s == NULL)              //  a recycled chunk is left unhashed at the tail to be used next
+    { if (new)
+        free(c->seq-1);
+      return (NULL);
+    }
+
+  if (new)
+    cache->nused += 1;
+  make_recent(cache,c,!new);
+
+  c->key  = key;
+  c->len  = end-beg;
+  c->next = cache->table[h];
+  cache->table[h] = c;
+  return (c);
+}
+
+char *Get_Cached_Piece(SeqCache *cache, int i, int beg, int end, char *buffer)
+{ SeqChunk *c;
+  int       k, kb, ke, b, e;
+
+  if (i < 0 || i >= cache->gdb->ncontig)
+    { EPRINTF(EPLACE,"%s: Index %d out of bounds (Get_Cached_Piece)\n",Prog_Name,i);
+      EXIT(NULL);
+    }
+  if (beg < 0 || end > cache->gdb->contigs[i].clen)
+    { EPRINTF(EPLACE,"%s: Subrange %d,%d out of bounds (Get_Cached_Piece)\n",Prog_Name,beg,end);
+      EXIT(NULL);
+    }
+
+  buffer[-1] = 4;
+  if (end <= beg)
+    { buffer[0] = 4;
+      return (buffer);
+    }
+
+  kb = beg / SEQ_CHUNK;
+  ke = (end-1) / SEQ_CHUNK;
+
+  pthread_mutex_lock(&(cache->mutex));
+  for (k = kb; k <= ke; k++)
+    { c = get_chunk(cache,i,k);
+      if (c == NULL)
+        { pthread_mutex_unlock(&(cache->mutex));
+          return (NULL);
+        }
+      b = k*SEQ_CHUNK;
+      e = b + c->len;
+      if (b < beg)
+        b = beg;
+      if (e > end)
+        e = end;
+      memcpy(buffer + (b-beg),c->seq + (b-k*SEQ_CHUNK),e-b);
+    }
+  pthread_mutex_unlock(&(cache->mutex));
+
+  buffer[end-beg] = 4;
+  return (buffer);
+}
+
+void Seq_Cache_Stats(SeqCache *cache, int64 *hits, int64 *misses, int64 *bytes)
+{ pthread_mutex_lock(&(cache->mutex));
+  *hits   = cache->nhit;
+  *misses = cache->nmiss;
+  *bytes  = ((int64) cache->nused) * SEQ_CHUNK;
+  pthread_mutex_unlock(&(cache->mutex));
+}
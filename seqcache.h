@@ -0,0 +1,61 @@
+/*****************************************************************************************\
+*                                                                                         *
+*  LRU cache of decoded sequence for a GDB                                                *
+*                                                                                         *
+*  Contig sequence is decoded to numeric form in aligned chunks of SEQ_CHUNK bases that   *
+*  are kept, up to a memory cap, in least-recently-used order so that repeated requests   *
+*  for the same region are served from memory without decoding or reading the .bps file.  *
+*                                                                                         *
+\*****************************************************************************************/
+
+#ifndef _SEQ_CACHE
+#define _SEQ_CACHE
+
+#include <pthread.h>
+
+#include "gene_core.h"
+#include "GDB.h"
+
+#define SEQ_CHUNK 0x10000    //  # of bases in a cache chunk (64Kbp)
+
+typedef struct _seqchunk
+  { int64              key;     //  contig<<32 | chunk # in contig, -1 if unused
+    int                len;     //  # of bases in chunk (< SEQ_CHUNK for the last in a contig)
+    char              *seq;     //  numeric sequence of the chunk
+    struct _seqchunk  *next;    //  hash chain
+    struct _seqchunk  *older;   //  LRU list, most recent at head
+    struct _seqchunk  *newer;
+  } SeqChunk;
+
+typedef struct
+  { GDB             *gdb;
+    pthread_mutex_t *lock;     //  if not NULL, guards reads of gdb
+    pthread_mutex_t  mutex;    //  guards the cache itself
+    int              nchunk;   //  # of chunks the memory cap allows
+    int              nused;    //  # of chunks in use
+    SeqChunk        *chunks;
+    SeqChunk       **table;    //  hash table of chunks in use
+    int              tmask;
+    SeqChunk        *head;     //  most and least recently used chunks
+    SeqChunk        *tail;
+    int64            nhit;     //  # of chunk requests found in the cache
+    int64            nmiss;    //  # of chunk requests that had to be decoded
+  } SeqCache;
+
+  //  Create a cache for gdb holding at most memory bytes of sequence (but always at least
+  //    2 chunks).  lock, if not NULL, guards the sequence reads of gdb.  Returns NULL with a
+  //    message in EPLACE if out of memory.
+
+SeqCache *New_Seq_Cache(GDB *gdb, pthread_mutex_t *lock, int64 memory);
+
+void Free_Seq_Cache(SeqCache *cache);
+
+  //  Like Get_Contig_Piece(gdb,i,beg,end,NUMERIC,buffer), but through the cache
+
+char *Get_Cached_Piece(SeqCache *cache, int i, int beg, int end, char *buffer);
+
+  //  Return the hit and miss counts and the bytes of sequence currently held
+
+void Seq_Cache_Stats(SeqCache *cache, int64 *hits, int64 *misses, int64 *bytes);
+
+#endif // _SEQ_CACHE
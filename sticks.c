@@ -64,27 +64,14 @@ int64 divide_bar(int64 t)
 }
 
 
-static void map(GDB *gdb, int format, int64 coord, int *sp, int *cp)
-{ GDB_SCAFFOLD *scf;
-  GDB_CONTIG   *ctg;
-  int           i, s, c;
-
-  scf = gdb->scaffolds;
-  ctg = gdb->contigs;
-
-  for (i = 0; i < gdb->nscaff; i++)                         //  binary search instead ?
-    if (ctg[scf[i].fctg].sbeg > coord)
-      break;
-  s = i-1;
+static void map(DotGDB *db, int format, int64 coord, int *sp, int *cp)
+{ int s, c;
 
+  s = Coord_Scaffold(db->coords,coord);
   if (format % 2 != 0)
-    { for (i = scf[s].fctg; i < scf[s].ectg; i++)
-        if (ctg[i].sbeg > coord)
-          break;
-      c = i-1;
-    }
+    c = Coord_Contig(db->coords,coord);
   else
-    c = scf[s].fctg;
+    c = db->gdb.scaffolds[s].fctg;
 
   *sp = s;
   *cp = c;
@@ -172,20 +159,22 @@ static char *write_coord(GDB *gdb, int format, int s, int c, int64 coord,
 }
 
 
-char *Map_Coord(GDB *gdb, int64 coord1, int64 coord2, int format, int64 width)
+char *Map_Coord(DotGDB *db, int64 coord1, int64 coord2, int format, int64 width)
 { static char answer1[5000];
   static char answer2[5000];
 
+  GDB   *gdb = &(db->gdb);
   double den;
   int    prec;
   char  *suf;
   int    s1, c1;
   int    s2, c2;
 
+  s1 = c1 = s2 = c2 = 0;
   if (coord1 >= 0)
-    map(gdb,format,coord1,&s1,&c1);
+    map(db,format,coord1,&s1,&c1);
   if (coord2 >= 0)
-    map(gdb,format,coord2,&s2,&c2);
+    map(db,format,coord2,&s2,&c2);
 
   den = digits(width,&suf,&prec);
 
@@ -243,6 +232,7 @@ static QuadNode *New_Quad()
       BLOCKS  = block;
       FREECNT = 0;
     }
+  BLOCKS[FREECNT].sum = NULL;
   return (BLOCKS+FREECNT++);
 }
 
@@ -502,6 +492,111 @@ static QuadNode *Add_To_Node(QuadNode *quad, Double_Box *frame, Double_Box *seg,
   }
 }
 
+//  Add to sum the piece of segment s in box, and count s if it starts in box, which is
+//    half-open save at the far edges of the plot (of size ALEN x BLEN)
+
+static double ALEN, BLEN;
+
+#define ID_BIN(iid)  ((iid) < ID_LOW ? 0 : (iid) - (ID_LOW-1))
+
+static void Clip_Sum(DotSegment *s, Double_Box *box, QuadSum *sum)
+{ double a0, a1, b0, b1;
+  double tb, te, t, u, len;
+
+  a0 = s->abeg;
+  a1 = s->aend;
+  b0 = s->bbeg;
+  b1 = s->bend;
+
+  if (a0 >= box->abeg && (a0 < box->aend || box->aend >= ALEN) &&
+      b0 >= box->bbeg && (b0 < box->bend || box->bend >= BLEN))
+    sum->nsegs += 1;
+
+  tb = (box->abeg - a0) / (a1 - a0);
+  te = (box->aend - a0) / (a1 - a0);
+  if (tb < 0.)
+    tb = 0.;
+  if (te > 1.)
+    te = 1.;
+  if (b1 != b0)
+    { t = (box->bbeg - b0) / (b1 - b0);
+      u = (box->bend - b0) / (b1 - b0);
+      if (t > u)
+        { len = t; t = u; u = len; }
+      if (t > tb)
+        tb = t;
+      if (u < te)
+        te = u;
+    }
+  else if (b0 < box->bbeg || b0 > box->bend)
+    return;
+  if (te <= tb)
+    return;
+
+  len = (te - tb) * (a1 - a0);
+  sum->abp += len;
+  if (b0 < b1)
+    sum->fbp += len;
+  sum->ibp += len * s->iid;
+  sum->hist[ID_BIN(s->iid)] += len;
+}
+
+static void Add_Sum(QuadSum *sum, QuadSum *add)
+{ int i;
+
+  sum->nsegs += add->nsegs;
+  sum->abp   += add->abp;
+  sum->fbp   += add->fbp;
+  sum->ibp   += add->ibp;
+  for (i = 0; i < ID_BINS; i++)
+    sum->hist[i] += add->hist[i];
+}
+
+static int64 Count_Interior(QuadNode *quad)
+{ int64 n;
+  int   i;
+
+  if (quad == NULL || quad->length > 0)
+    return (0);
+  n = 1;
+  for (i = 0; i < 4; i++)
+    n += Count_Interior(quad->quads[i]);
+  return (n);
+}
+
+//  Set the sums of the interior nodes below quad (whose frame is frame) taking them from
+//    *next on, and add the sum of quad to sum
+
+static void Sum_QuadNode(QuadNode *quad, Double_Box *frame, QuadSum **next, QuadSum *sum)
+{ Double_Box sub;
+  QuadSum   *qs;
+  double     amid, bmid;
+  int        i;
+
+  if (quad == NULL)
+    return;
+
+  if (quad->length > 0)
+    { for (i = 0; i < quad->length; i++)
+        Clip_Sum(SEGS + ((QuadLeaf *) quad)->idx[i],frame,sum);
+      return;
+    }
+
+  qs = (*next)++;
+  bzero(qs,sizeof(QuadSum));
+
+  amid = (frame->abeg+frame->aend)/2.;
+  bmid = (frame->bbeg+frame->bend)/2.;
+  for (i = 0; i < 4; i++)
+    { sub = *frame;
+      QUAD_CUT(&sub,amid,bmid,i);
+      Sum_QuadNode(quad->quads[i],&sub,next,qs);
+    }
+
+  quad->sum = qs;
+  Add_Sum(sum,qs);
+}
+
 static void Make_QuadTree(DotPlot *plot, int ilay)
 { QuadNode  *quad;
   Double_Box seg;
@@ -531,6 +626,19 @@ static void Make_QuadTree(DotPlot *plot, int ilay)
      }
   plot->layers[ilay]->qtree  = quad;
   plot->layers[ilay]->blocks = BLOCKS;
+
+  { QuadSum *sums, all;
+
+    frame.abeg = 0.;
+    frame.bbeg = 0.;
+    frame.aend = ALEN = plot->alen;
+    frame.bend = BLEN = plot->blen;
+    bzero(&all,sizeof(QuadSum));
+    sums = malloc(sizeof(QuadSum)*(Count_Interior(quad)+1));
+    plot->layers[ilay]->sums = sums;
+    if (sums != NULL)
+      Sum_QuadNode(quad,&frame,&sums,&all);
+  }
 }
 
 static char *QLabel[] = { "NW", "NE", "SE", "SW", " *" };
@@ -780,6 +888,97 @@ QuadLeaf *Plot_Layer(DotPlot *plot, int ilay, Frame *query)
   return ((QuadLeaf *) BLOCKS);
 }
 
+//  Add to sum the pieces in query of the segments below quad (whose frame is frame), taking
+//    the sums of interior nodes inside query
+
+static void QuadNode_Sum(QuadNode *quad, Double_Box *frame, Double_Box *query, QuadSum *sum)
+{ Double_Box box;
+  double     amid, bmid;
+  int        i, inside;
+
+  if (quad == NULL)
+    return;
+  if (frame->aend <= query->abeg || frame->abeg >= query->aend ||
+      frame->bend <= query->bbeg || frame->bbeg >= query->bend)
+    return;
+
+  inside = (frame->abeg >= query->abeg && frame->aend <= query->aend &&
+            frame->bbeg >= query->bbeg && frame->bend <= query->bend);
+
+  if (quad->length > 0)
+    { box = *frame;
+      if (box.abeg < query->abeg)
+        box.abeg = query->abeg;
+      if (box.aend > query->aend)
+        box.aend = query->aend;
+      if (box.bbeg < query->bbeg)
+        box.bbeg = query->bbeg;
+      if (box.bend > query->bend)
+        box.bend = query->bend;
+      for (i = 0; i < quad->length; i++)
+        Clip_Sum(SEGS + ((QuadLeaf *) quad)->idx[i],&box,sum);
+      return;
+    }
+
+  if (inside && quad->sum != NULL)
+    { Add_Sum(sum,quad->sum);
+      return;
+    }
+
+  amid = (frame->abeg+frame->aend)/2.;
+  bmid = (frame->bbeg+frame->bend)/2.;
+  for (i = 0; i < 4; i++)
+    { box = *frame;
+      QUAD_CUT(&box,amid,bmid,i);
+      QuadNode_Sum(quad->quads[i],&box,query,sum);
+    }
+}
+
+void Region_Stats(DotPlot *plot, int ilay, Frame *region, RegionStats *stats)
+{ Double_Box frame;
+  Double_Box qbox;
+  QuadSum    sum;
+  double     half, cum;
+  int        i;
+
+  SEGS = plot->layers[ilay]->segs;
+  ALEN = plot->alen;
+  BLEN = plot->blen;
+
+  qbox.abeg = region->x;
+  qbox.bbeg = region->y;
+  qbox.aend = region->x + region->w;
+  qbox.bend = region->y + region->h;
+
+  frame.abeg = 0.;
+  frame.bbeg = 0.;
+  frame.aend = plot->alen;
+  frame.bend = plot->blen;
+
+  bzero(&sum,sizeof(QuadSum));
+  QuadNode_Sum(plot->layers[ilay]->qtree,&frame,&qbox,&sum);
+
+  stats->nsegs = sum.nsegs;
+  stats->abp   = sum.abp;
+  stats->fbp   = sum.fbp;
+  if (sum.abp > 0.)
+    stats->mean = sum.ibp / sum.abp;
+  else
+    stats->mean = 0.;
+
+  half = 0.;
+  for (i = 0; i < ID_BINS; i++)
+    half += sum.hist[i];
+  half /= 2.;
+  cum = 0.;
+  for (i = 0; i < ID_BINS-1; i++)
+    { cum += sum.hist[i];
+      if (cum >= half && cum > 0.)
+        break;
+    }
+  stats->median = ID_LOW-1 + i;
+}
+
 
 /*******************************************************************************************
 *
@@ -809,7 +1008,6 @@ DotPlot *copyPlot(DotPlot *model)
   plot->db2->nref += 1;
   for (j = 1; j < plot->nlays; j++)
     plot->layers[j]->nref += 1;
-  plot->dotref += 1;
   return (plot);
 }
 
@@ -928,6 +1126,10 @@ DotPlot *createPlot(char *alnPath, int lCut, int iCut, int sCut, DotPlot *model)
         db1->nref = 1;
         db1->name = Root(src1_name,NULL);
         db1->gdb  = _gdb1;
+        db1->index = NULL;
+        db1->cache = NULL;
+        db1->coords = NULL;
+        pthread_mutex_init(&(db1->lock),NULL);
         if (src2_name == NULL)
           { db2 = db1;
             db2->nref += 1;
@@ -941,12 +1143,14 @@ DotPlot *createPlot(char *alnPath, int lCut, int iCut, int sCut, DotPlot *model)
             db2->nref = 1;
             db2->name = Root(src2_name,NULL);
             db2->gdb  = _gdb2;
+            db2->index = NULL;
+            db2->cache = NULL;
+            db2->coords = NULL;
+            pthread_mutex_init(&(db2->lock),NULL);
           }
 
         plot->db1 = db1;
         plot->db2 = db2;
-        plot->dotref = 1;
-        plot->dotmemory = dotplot_memory();
       }
     else
       { int comp1, comp2;
@@ -1070,6 +1274,34 @@ DotPlot *createPlot(char *alnPath, int lCut, int iCut, int sCut, DotPlot *model)
   
       plot->alen = contigs1[scaffs1[nscaff1-1].fctg].sbeg + scaffs1[nscaff1-1].slen;
       plot->blen = contigs2[scaffs2[nscaff2-1].fctg].sbeg + scaffs2[nscaff2-1].slen;
+
+      //  Index the global coordinates of the scaffolds and contigs
+
+      db1->coords = New_Coord_Index(gdb1);
+      if (db1->coords == NULL)
+        goto error4;
+      if (db1 != db2)
+        { db2->coords = New_Coord_Index(gdb2);
+          if (db2->coords == NULL)
+            goto error4;
+        }
+
+      //  Memory map the .bps files so sequence can be read by any thread without a lock
+      //    (if a map fails the GDB simply stays on its file pointer), map the dot plot
+      //    minimizer indices if they have been built, and set up the sequence caches
+
+      if (gdb1->seqs != NULL)
+        { Map_Sequences(gdb1);
+          db1->index = Open_Dot_Index(gdb1);
+          db1->cache = New_Seq_Cache(gdb1,(gdb1->seqstate == EXTERNAL) ? &(db1->lock) : NULL,
+                                     SEQ_CACHE_MEMORY);
+        }
+      if (db1 != db2 && gdb2->seqs != NULL)
+        { Map_Sequences(gdb2);
+          db2->index = Open_Dot_Index(gdb2);
+          db2->cache = New_Seq_Cache(gdb2,(gdb2->seqstate == EXTERNAL) ? &(db2->lock) : NULL,
+                                     SEQ_CACHE_MEMORY);
+        }
     }
 
   //  Add layer
@@ -1209,6 +1441,8 @@ DotPlot *createPlot(char *alnPath, int lCut, int iCut, int sCut, DotPlot *model)
     layer->nref   = 1;
     layer->name   = Root(alnPath,NULL);
     layer->input  = input;
+    pthread_mutex_init(&(layer->lock),NULL);
+    layer->traces = NULL;
     layer->tspace = tspace;
     layer->novls  = novl;
     layer->segs   = segs;
@@ -1236,9 +1470,11 @@ error3:
 error2:
   if (model == NULL)
     { if (db1 != db2)
-        { free(db2->name);
+        { Free_Coord_Index(db2->coords);
+          free(db2->name);
           free(db2);
         }
+      Free_Coord_Index(db1->coords);
       free(db1->name);
       free(db1);
       if (gdb2 != gdb1)
@@ -1271,23 +1507,73 @@ static void Free_DotGDB(DotGDB *db)
     return;
   Free_Hash_Table(db->hash);
   free(db->name);
+  Close_Dot_Index(db->index);
+  Free_Seq_Cache(db->cache);
+  Free_Coord_Index(db->coords);
   Close_GDB(&(db->gdb));
+  pthread_mutex_destroy(&(db->lock));
   free(db);
 }
 
+static int Index_DotGDB(DotGDB *db, int nthreads, volatile int *cancel, volatile int64 *done)
+{ pthread_mutex_t *lock;
+
+  if (db->gdb.seqstate == EXTERNAL)
+    lock = &(db->lock);
+  else
+    lock = NULL;
+  if (Build_Dot_Index(&(db->gdb),lock,nthreads,cancel,done))
+    return (1);
+  Close_Dot_Index(db->index);
+  db->index = Open_Dot_Index(&(db->gdb));
+  if (db->index == NULL)
+    { sprintf(EPLACE,"Could not map index %s\n",Dot_Index_Path(&(db->gdb)));
+      return (1);
+    }
+  return (0);
+}
+
+int Index_DotPlot(DotPlot *plot, int nthreads, volatile int *cancel, volatile int64 *done)
+{ *done = 0;
+  if (Index_DotGDB(plot->db1,nthreads,cancel,done))
+    return (1);
+  if (plot->db2 != plot->db1)
+    return (Index_DotGDB(plot->db2,nthreads,cancel,done));
+  return (0);
+}
+
+void Cache_Stats(DotPlot *plot, int64 *hits, int64 *misses, int64 *bytes)
+{ int64 h, m, b;
+
+  *hits = *misses = *bytes = 0;
+  if (plot->db1->cache != NULL)
+    Seq_Cache_Stats(plot->db1->cache,hits,misses,bytes);
+  if (plot->db2 != plot->db1 && plot->db2->cache != NULL)
+    { Seq_Cache_Stats(plot->db2->cache,&h,&m,&b);
+      *hits   += h;
+      *misses += m;
+      *bytes  += b;
+    }
+}
+
+static void Purge_Align_Cache(DotLayer *layer);
+static void Free_Trace_Cache(DotLayer *layer);
+
 void Free_DotPlot(DotPlot *plot)
 { int i;
 
   for (i = 0; i < plot->nlays; i++)
     { if (plot->layers[i] == NULL || plot->layers[i]->nref-- > 1)
         continue;
+      Purge_Align_Cache(plot->layers[i]);
+      Free_Trace_Cache(plot->layers[i]);
       Free_List((QuadLeaf *) (plot->layers[i]->blocks));
       free(plot->layers[i]->name);
       free(plot->layers[i]->segs);
+      free(plot->layers[i]->sums);
       oneFileClose(plot->layers[i]->input);
+      pthread_mutex_destroy(&(plot->layers[i]->lock));
     }
-  if (plot->dotref-- <= 1)
-    free(plot->dotmemory);
   Free_DotGDB(plot->db1);
   Free_DotGDB(plot->db2);
   free(plot);
@@ -1310,31 +1596,125 @@ static void print_seq(char *seq)
   fflush(stdout);
 }
 
-static int   textlen;
-static char *alnptr;
+  //  An alignment is displayed as the rows of Transmit_Alignment(..,ALIGN_WIDTH,0,0,
+  //    ALIGN_COORD,0), 4 per block of ALIGN_WIDTH columns, but only the rows asked for are
+  //    formatted.  A column cursor is kept for the start of every block so that any row can
+  //    be produced by walking the columns of its block alone.
 
-static void align_length(char *bit)
-{ textlen += strlen(bit); }
+#define ALIGN_WIDTH 100
+#define ALIGN_COORD   9
 
-static void align_cat(char *bit)
-{ alnptr += sprintf(alnptr,"%s",bit); }
+typedef struct
+  { int i, j;     //  next a and b positions (1-based as in Transmit_Alignment)
+    int c;        //  next trace element
+  } AlnMark;
+
+static char N2A[8] = { 'a', 'c', 'g', 't', '.', '[', ']', '-' };
+
+struct _align_job
+  { DotGDB    *db1;
+    DotGDB    *db2;
+    DotLayer  *layer;     //  alignment idx of layer
+    int        idx;
+    int        nref;      //  # of holders (the cache is one if it holds the job)
+    int        tspace;
+    Overlap    ovl;
+    Alignment  aln;
+    uint16    *trace;     //  trace points read from the .1aln file
+    int       *ptrace;    //  exact trace stitched from pieces computed in parallel
+    Work_Data *work;
+    char      *aseq;      //  sequence buffers for the aligned intervals
+    char      *bseq;
+    int64      aoffs;     //  offsets of the aligned contigs in their scaffolds
+    int64      boffs;
+    char       title[500];
+    int        ascaf;     //  scaffolds and forward strand scaffold intervals aligned
+    int        bscaf;
+    int64      abeg, aend;
+    int64      bbeg, bend;
+    int64      nblock;    //  once computed: # of blocks of the alignment
+    AlnMark   *marks;     //  column cursor at the start of each block
+    int64      bytes;     //  memory held once computed
+    AlignJob  *newer;     //  LRU list of the cache if held by it
+    AlignJob  *older;
+    AlignJob  *next;      //  next job of its hash chain if held by the cache
+  };
+
+//  The cache of computed alignments is a hash table of ALIGN_BUCKETS chains keyed by layer
+//    and segment index, and an LRU list of the jobs present, under a global lock that also
+//    guards the reference counts of all jobs
+
+#define ALIGN_BUCKETS 1024   //  a power of 2
+
+static pthread_mutex_t CACHE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static AlignJob       *CACHE_HASH[ALIGN_BUCKETS];
+static AlignJob       *CACHE_NEW = NULL;
+static AlignJob       *CACHE_OLD = NULL;
+static int64           CACHE_BYTES  = 0;
+static int64           CACHE_HITS   = 0;
+static int64           CACHE_MISSES = 0;
+
+static inline AlignJob **cache_chain(DotLayer *layer, int idx)
+{ return (CACHE_HASH + (((((uint64) layer) >> 4) + idx) & (ALIGN_BUCKETS-1))); }
+
+static AlignJob *cache_find(DotLayer *layer, int idx)
+{ AlignJob *job;
+
+  for (job = *cache_chain(layer,idx); job != NULL; job = job->next)
+    if (job->layer == layer && job->idx == idx)
+      break;
+  return (job);
+}
+
+static void cache_add(AlignJob *job)
+{ AlignJob **c = cache_chain(job->layer,job->idx);
 
-char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **title)
-{ static Work_Data *work = NULL;
-  static int        a_max = 0;
-  static char      *aseq = NULL;
-  static int        b_max = 0;
-  static char      *bseq = NULL;
-  static int        t_max = 0;
-  static uint16    *trace = NULL;
-  static int        l_max = 0;
-  static char      *atext = NULL;
-  static char      *tptr;
-  static char       atitle[500];
+  job->next = *c;
+  *c = job;
+}
 
-  Overlap   _ovl, *ovl = &_ovl;
-  Alignment _aln, *aln = &_aln;
-  Path      *path = &(_ovl.path);
+static void cache_remove(AlignJob *job)
+{ AlignJob **c;
+
+  for (c = cache_chain(job->layer,job->idx); *c != job; c = &((*c)->next))
+    continue;
+  *c = job->next;
+  job->next = NULL;
+}
+
+static void cache_unlink(AlignJob *job)
+{ if (job->newer == NULL)
+    CACHE_NEW = job->older;
+  else
+    job->newer->older = job->older;
+  if (job->older == NULL)
+    CACHE_OLD = job->newer;
+  else
+    job->older->newer = job->newer;
+  job->newer = job->older = NULL;
+  CACHE_BYTES -= job->bytes;
+}
+
+static void cache_push(AlignJob *job)
+{ job->older = CACHE_NEW;
+  job->newer = NULL;
+  if (CACHE_NEW == NULL)
+    CACHE_OLD = job;
+  else
+    CACHE_NEW->newer = job;
+  CACHE_NEW = job;
+  CACHE_BYTES += job->bytes;
+}
+
+static void free_job(AlignJob *job);
+
+//  Read the alignment of seg into a new job that is not in the cache
+
+static AlignJob *new_job(DotPlot *plot, DotLayer *layer, DotSegment *seg)
+{ AlignJob *job;
+  Overlap  *ovl;
+  Path     *path;
+  char     *tptr;
 
   GDB          *gdb1    = &(plot->db1->gdb);
   GDB          *gdb2    = &(plot->db2->gdb);
@@ -1346,55 +1726,74 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
 
   int acont, bcont;
   int ascaf, bscaf;
-  int64 aclen, bclen;
+  int64 bclen;
   int64 aslen, bslen;
   int64 aoffs, boffs;
-  int   amin, amax;
-  int   bmin, bmax;
 
-  (void) print_seq;
+  if (plot->db1->cache == NULL || plot->db2->cache == NULL)
+    { sprintf(EPLACE,"The genomes of the plot have no sequence\n");
+      return (NULL);
+    }
 
-  if ( ! oneGoto(in,'A',seg->idx+1))
+  job = (AlignJob *) Malloc(sizeof(AlignJob),"Allocating alignment job");
+  if (job == NULL)
     return (NULL);
-
-  if (work == NULL)
-    { work = New_Work_Data();
-      if (work == NULL)
-        return (NULL);
+  job->trace = (uint16 *) Malloc(2*sizeof(uint16)*(in->info['T']->given.max+1),
+                                 "Allocating trace vector");
+  if (job->trace == NULL)
+    { free(job);
+      return (NULL);
     }
-
-  if (in->info['T']->given.max > t_max)
-    { t_max = in->info['T']->given.max;
-      trace = (uint16 *) Realloc(trace,2*sizeof(uint16)*t_max,"Allocating trace vector");
-      if (trace == NULL)
-        { t_max = 0;
-          return (NULL);
-        }
+  job->db1    = plot->db1;
+  job->db2    = plot->db2;
+  job->layer  = layer;
+  job->idx    = seg->idx;
+  job->nref   = 1;
+  job->bytes  = 0;
+  job->newer  = NULL;
+  job->older  = NULL;
+  job->next   = NULL;
+  job->tspace = layer->tspace;
+  job->work   = NULL;
+  job->ptrace = NULL;
+  job->aseq   = NULL;
+  job->bseq   = NULL;
+  job->nblock = 0;
+  job->marks  = NULL;
+
+  ovl  = &(job->ovl);
+  path = &(ovl->path);
+
+  pthread_mutex_lock(&(layer->lock));
+  if ( ! oneGoto(in,'A',seg->idx+1))
+    { pthread_mutex_unlock(&(layer->lock));
+      sprintf(EPLACE,"Could not find alignment %d in %s\n",seg->idx+1,layer->name);
+      free(job->trace);
+      free(job);
+      return (NULL);
     }
-
   oneReadLine(in);
   Read_Aln_Overlap(in,ovl);
-  path->tlen  = Read_Aln_Trace(in,(uint8 *) trace);
-  path->trace = trace;
+  path->tlen  = Read_Aln_Trace(in,(uint8 *) job->trace);
+  path->trace = job->trace;
+  pthread_mutex_unlock(&(layer->lock));
 
   acont = ovl->aread;
   bcont = ovl->bread;
   ascaf = acontig[acont].scaf;
   bscaf = bcontig[bcont].scaf;
-  aclen = acontig[acont].clen;
   bclen = bcontig[bcont].clen;
   aslen = ascaffs[ascaf].slen;
   bslen = bscaffs[bscaf].slen;
   aoffs = acontig[acont].sbeg - acontig[ascaffs[ascaf].fctg].sbeg;
   boffs = bcontig[bcont].sbeg - bcontig[bscaffs[bscaf].fctg].sbeg;
 
-  aln->path  = path = &(ovl->path);
-  aln->alen  = aclen;
-  aln->blen  = bclen;
-  aln->flags = ovl->flags;
+  job->aoffs = aoffs;
+  job->boffs = boffs;
 
   { int64 ab, ae;
     int64 bb, be;
+    char *atitle = job->title;
 
     tptr = atitle + Number_To_String((int64) ascaf+1,0,atitle);
     tptr += sprintf(tptr,".%dn",(acont - ascaffs[ascaf].fctg)+1);
@@ -1422,6 +1821,13 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
       { bb = boffs+path->bbpos;
         be = boffs+path->bepos;
       }
+    job->ascaf = ascaf;
+    job->bscaf = bscaf;
+    job->abeg  = ab;
+    job->aend  = ae;
+    job->bbeg  = (bb < be) ? bb : be;
+    job->bend  = (bb < be) ? be : bb;
+
     if (bb == 0 || bb == bslen)
       tptr += sprintf(tptr,"<");
     else
@@ -1435,6 +1841,259 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
       tptr += sprintf(tptr,"]");
   }
 
+  return (job);
+}
+
+AlignJob *New_Align_Job(DotPlot *plot, DotLayer *layer, DotSegment *seg)
+{ AlignJob *job;
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  job = cache_find(layer,seg->idx);
+  if (job != NULL)
+    { cache_unlink(job);
+      cache_push(job);
+      job->nref += 1;
+      CACHE_HITS += 1;
+    }
+  else
+    CACHE_MISSES += 1;
+  pthread_mutex_unlock(&CACHE_LOCK);
+
+  if (job != NULL)
+    return (job);
+  return (new_job(plot,layer,seg));
+}
+
+char *Align_Job_Title(AlignJob *job)
+{ return (job->title); }
+
+void Free_Align_Job(AlignJob *job)
+{ int nref;
+
+  if (job == NULL)
+    return;
+  pthread_mutex_lock(&CACHE_LOCK);
+  nref = --job->nref;
+  pthread_mutex_unlock(&CACHE_LOCK);
+  if (nref == 0)
+    free_job(job);
+}
+
+static void free_job(AlignJob *job)
+{ free(job->marks);
+  if (job->bseq != NULL)
+    free(job->bseq-1);
+  if (job->aseq != NULL)
+    free(job->aseq-1);
+  if (job->work != NULL)
+    Free_Work_Data(job->work);
+  free(job->ptrace);
+  free(job->trace);
+  free(job);
+}
+
+//  Set *u and *v to the a- and b-symbols of the alignment column at cursor m and advance it.
+//    Returns 0 if there are no more columns.
+
+static int next_column(AlignJob *job, AlnMark *m, int *u, int *v)
+{ Path *path  = job->aln.path;
+  int  *trace = (int *) path->trace;
+  char *a     = job->aln.aseq - 1;
+  char *b     = job->aln.bseq - 1;
+  int   p;
+
+  if (m->c < path->tlen)
+    { p = trace[m->c];
+      if (p < 0)
+        { if (m->i != -p)
+            { *u = a[m->i++];
+              *v = b[m->j++];
+            }
+          else
+            { *u = 7;
+              *v = b[m->j++];
+              m->c += 1;
+            }
+        }
+      else
+        { if (m->j != p)
+            { *u = a[m->i++];
+              *v = b[m->j++];
+            }
+          else
+            { *u = a[m->i++];
+              *v = 7;
+              m->c += 1;
+            }
+        }
+      return (1);
+    }
+  if (m->i <= path->aepos)
+    { *u = a[m->i++];
+      *v = b[m->j++];
+      return (1);
+    }
+  return (0);
+}
+
+//  The trace point intervals of a long alignment are divided among threads in pieces of at
+//    least PIECE_MIN intervals, each piece being aligned as a sub-alignment of its own with
+//    Compute_Trace_PTS.  As pieces begin and end at trace points, their traces are exactly
+//    those the whole would have, and are simply concatenated.
+
+#define PIECE_MIN 500
+
+typedef struct
+  { Alignment  aln;
+    Path       path;
+    Work_Data *work;
+    int        tspace;
+    int        fail;
+  } TracePiece;
+
+static void *trace_piece(void *arg)
+{ TracePiece *pc = (TracePiece *) arg;
+
+  pc->fail = Compute_Trace_PTS(&(pc->aln),pc->work,pc->tspace,GREEDIEST,1,-1);
+  return (NULL);
+}
+
+//  Compute the exact trace of aln with work in the first piece and up to nthreads pieces.
+//    Returns -1 if the alignment is too short to divide, 0 on success, 1 on failure.
+
+static int trace_parallel(AlignJob *job, Alignment *aln, Work_Data *work, int nthreads)
+{ Path       *path   = aln->path;
+  uint16     *points = (uint16 *) path->trace;
+  int         npairs = path->tlen/2;
+  TracePiece *pcs;
+  pthread_t  *threads;
+  int64       ab, bb, tlen;
+  int         p, k, n, t, fail;
+
+  if (nthreads > npairs/PIECE_MIN)
+    nthreads = npairs/PIECE_MIN;
+  if (nthreads <= 1)
+    return (-1);
+
+  pcs     = (TracePiece *) Malloc(sizeof(TracePiece)*nthreads,"Allocating trace pieces");
+  threads = (pthread_t *) Malloc(sizeof(pthread_t)*nthreads,"Allocating trace pieces");
+  if (pcs == NULL || threads == NULL)
+    { free(threads);
+      free(pcs);
+      return (1);
+    }
+
+  //  Piece t has pairs [p,p+n) and starts at a-trace point ab (or abpos) and b position bb
+
+  ab = (path->abpos/job->tspace)*job->tspace;
+  bb = path->bbpos;
+  p  = 0;
+  for (t = 0; t < nthreads; t++)
+    { n = (npairs-p)/(nthreads-t);
+
+      pcs[t].aln         = *aln;
+      pcs[t].aln.path    = &(pcs[t].path);
+      pcs[t].path        = *path;
+      pcs[t].path.trace  = points + 2*p;
+      pcs[t].path.tlen   = 2*n;
+      pcs[t].path.abpos  = (p == 0) ? path->abpos : ab + p*job->tspace;
+      pcs[t].path.bbpos  = bb;
+      for (k = p; k < p+n; k++)
+        bb += points[2*k+1];
+      p += n;
+      pcs[t].path.aepos  = (p == npairs) ? path->aepos : ab + p*job->tspace;
+      pcs[t].path.bepos  = (p == npairs) ? path->bepos : bb;
+      pcs[t].tspace      = job->tspace;
+      pcs[t].fail        = 0;
+      if (t == 0)
+        pcs[t].work = work;
+      else
+        { pcs[t].work = New_Work_Data();
+          if (pcs[t].work == NULL)
+            { nthreads = t;
+              fail = 1;
+              goto cleanup;
+            }
+        }
+    }
+
+  fail = 0;
+  for (t = 1; t < nthreads; t++)
+    if (pthread_create(threads+t,NULL,trace_piece,pcs+t) != 0)
+      { sprintf(EPLACE,"Could not start alignment threads\n");
+        fail = 1;
+        break;
+      }
+  trace_piece(pcs);
+  while (--t > 0)
+    pthread_join(threads[t],NULL);
+
+  if ( ! fail)
+    { tlen = 0;
+      for (t = 0; t < nthreads; t++)
+        if (pcs[t].fail)
+          { sprintf(EPLACE,"Could not compute the alignment\n");
+            fail = 1;
+          }
+        else
+          tlen += pcs[t].path.tlen;
+    }
+
+  if ( ! fail)
+    { job->ptrace = (int *) Malloc(sizeof(int)*(tlen+1),"Allocating alignment trace");
+      if (job->ptrace == NULL)
+        fail = 1;
+    }
+
+  if ( ! fail)
+    { path->tlen  = 0;
+      path->diffs = 0;
+      for (t = 0; t < nthreads; t++)
+        { memcpy(job->ptrace+path->tlen,pcs[t].path.trace,sizeof(int)*pcs[t].path.tlen);
+          path->tlen  += pcs[t].path.tlen;
+          path->diffs += pcs[t].path.diffs;
+        }
+      path->trace = job->ptrace;
+    }
+
+cleanup:
+  for (t = 1; t < nthreads; t++)
+    Free_Work_Data(pcs[t].work);
+  free(threads);
+  free(pcs);
+  return (fail);
+}
+
+//  Compute the alignment of job with working storage work and up to nthreads threads
+
+static int run_job(AlignJob *job, Work_Data *work, int nthreads, volatile int *cancel)
+{ Overlap   *ovl  = &(job->ovl);
+  Alignment *aln  = &(job->aln);
+  Path      *path = &(ovl->path);
+
+  GDB_CONTIG *acontig = job->db1->gdb.contigs;
+  GDB_CONTIG *bcontig = job->db2->gdb.contigs;
+
+  int   acont, bcont;
+  int64 aclen, bclen;
+  int64 aoffs, boffs;
+  int   amin, amax;
+  int   bmin, bmax;
+
+  (void) print_seq;
+
+  acont = ovl->aread;
+  bcont = ovl->bread;
+  aclen = acontig[acont].clen;
+  bclen = bcontig[bcont].clen;
+  aoffs = job->aoffs;
+  boffs = job->boffs;
+
+  aln->path  = path;
+  aln->alen  = aclen;
+  aln->blen  = bclen;
+  aln->flags = ovl->flags;
+
   amin = path->abpos;
   amax = path->aepos;
   if (COMP(aln->flags))
@@ -1446,36 +2105,23 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
       bmax = path->bepos;
     }
 
-  if (amax-amin > a_max)
-    { a_max = amax-amin;
-      if (aseq == NULL)
-        aseq = (char *) Malloc(a_max+12,"Allocating sequence buffer");
-      else
-        aseq = (char *) Realloc(aseq-1,a_max+12,"Allocating sequence buffer");
-      if (aseq == NULL)
-        { a_max = 0;
-          return (NULL);
-        }
-      aseq += 1;
-    }
-
-  if (bmax-bmin > b_max)
-    { b_max = bmax-bmin;
-      if (bseq == NULL)
-        bseq = (char *) Malloc(b_max+12,"Allocating sequence buffer");
-      else
-        bseq = (char *) Realloc(bseq-1,b_max+12,"Allocating sequence buffer");
-      if (bseq == NULL)
-        { b_max = 0;
-          return (NULL);
-        }
-      bseq += 1;
-    }
+  job->aseq = (char *) Malloc((amax-amin)+12,"Allocating sequence buffer");
+  if (job->aseq == NULL)
+    return (1);
+  job->aseq += 1;
+  job->bseq = (char *) Malloc((bmax-bmin)+12,"Allocating sequence buffer");
+  if (job->bseq == NULL)
+    return (1);
+  job->bseq += 1;
 
   Decompress_TraceTo16(ovl);
 
-  aln->aseq = Get_Contig_Piece(gdb1,acont,amin,amax,NUMERIC,aseq);
-  aln->bseq = Get_Contig_Piece(gdb2,bcont,bmin,bmax,NUMERIC,bseq);
+  aln->aseq = Get_Cached_Piece(job->db1->cache,acont,amin,amax,job->aseq);
+  aln->bseq = Get_Cached_Piece(job->db2->cache,bcont,bmin,bmax,job->bseq);
+  if (aln->aseq == NULL || aln->bseq == NULL)
+    return (1);
+  if (*cancel)
+    return (1);
 
   aln->aseq -= amin;
   if (COMP(aln->flags))
@@ -1485,9 +2131,22 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
   else
     aln->bseq -= bmin;
 
-  Compute_Trace_PTS(aln,work,layer->tspace,GREEDIEST,1,-1);
+  switch (trace_parallel(job,aln,work,nthreads))
+  { case -1:
+      if (Compute_Trace_PTS(aln,work,job->tspace,GREEDIEST,1,-1))
+        { sprintf(EPLACE,"Could not compute the alignment\n");
+          return (1);
+        }
+      break;
+    case 1:
+      return (1);
+  }
+  if (*cancel)
+    return (1);
 
   Gap_Improver(aln,work);
+  if (*cancel)
+    return (1);
 
   { int   tlen   = path->tlen;
     int  *itrace = (int *) path->trace;
@@ -1512,21 +2171,875 @@ char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **t
         itrace[i] += boffs;
   }
 
-  textlen = 0;
-  Transmit_Alignment(align_length,aln,work,100,0,0,9,0);
+  //  Mark the start of every block (there are never more columns than a- plus b-bases)
 
-  if (textlen > l_max)
-    { l_max = 1.2*textlen + 1001; 
-      atext = Realloc(atext,l_max+1,"Reallocating alignment text");
-      if (atext == NULL)
-        { l_max = 0;
-          return (NULL);
+  { AlnMark m;
+    int64   n, k;
+    int     u, v;
+
+    n = ((path->aepos-path->abpos) + (path->bepos-path->bbpos)) / ALIGN_WIDTH + 1;
+    job->marks = (AlnMark *) Malloc(sizeof(AlnMark)*n,"Allocating alignment block index");
+    if (job->marks == NULL)
+      return (1);
+
+    m.i = path->abpos+1;
+    m.j = path->bbpos+1;
+    m.c = 0;
+    job->marks[0] = m;
+    k = 0;
+    for (n = 1; next_column(job,&m,&u,&v); n++)
+      if (n % ALIGN_WIDTH == 0)
+        job->marks[++k] = m;
+    if ((n-1) % ALIGN_WIDTH == 0 && k > 0)   //  last mark is at the end
+      k -= 1;
+    job->nblock = k+1;
+  }
+
+  return (0);
+}
+
+//  Once computed, the job keeps only what its rows need (the trace is moved out of the
+//    working storage which is freed) and is placed in the cache, evicting the least recently
+//    used jobs while the cache is over ALIGN_CACHE_MEMORY
+
+int Run_Align_Job(AlignJob *job, int nthreads, volatile int *cancel)
+{ Path     *path = &(job->ovl.path);
+  AlignJob *old;
+
+  if (job->nblock > 0)      //  from the cache
+    return (0);
+
+  job->work = New_Work_Data();
+  if (job->work == NULL)
+    return (1);
+  if (run_job(job,job->work,nthreads,cancel))
+    return (1);
+
+  if (job->ptrace == NULL)
+    { job->ptrace = (int *) Malloc(sizeof(int)*(path->tlen+1),"Allocating alignment trace");
+      if (job->ptrace == NULL)
+        return (1);
+      memcpy(job->ptrace,path->trace,sizeof(int)*path->tlen);
+      path->trace = job->ptrace;
+    }
+  Free_Work_Data(job->work);
+  job->work = NULL;
+  free(job->trace);
+  job->trace = NULL;
+
+  job->bytes = sizeof(AlignJob) + sizeof(int)*path->tlen + sizeof(AlnMark)*job->nblock
+             + (path->aepos-path->abpos) + (path->bepos-path->bbpos) + 24;
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  if (cache_find(job->layer,job->idx) == NULL)
+    { job->nref += 1;
+      cache_add(job);
+      cache_push(job);
+      while (CACHE_BYTES > ALIGN_CACHE_MEMORY && CACHE_OLD != job)
+        { old = CACHE_OLD;
+          cache_remove(old);
+          cache_unlink(old);
+          if (--old->nref == 0)
+            free_job(old);
+        }
+    }
+  pthread_mutex_unlock(&CACHE_LOCK);
+
+  return (0);
+}
+
+void Align_Cache_Stats(int64 *hits, int64 *misses, int64 *bytes)
+{ pthread_mutex_lock(&CACHE_LOCK);
+  *hits   = CACHE_HITS;
+  *misses = CACHE_MISSES;
+  *bytes  = CACHE_BYTES;
+  pthread_mutex_unlock(&CACHE_LOCK);
+}
+
+//  Drop the cached alignments of layer, which is about to be freed
+
+static void Purge_Align_Cache(DotLayer *layer)
+{ AlignJob *job, *older;
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  for (job = CACHE_NEW; job != NULL; job = older)
+    { older = job->older;
+      if (job->layer == layer)
+        { cache_remove(job);
+          cache_unlink(job);
+          if (--job->nref == 0)
+            free_job(job);
+        }
+    }
+  pthread_mutex_unlock(&CACHE_LOCK);
+}
+
+int64 Align_Job_Rows(AlignJob *job)
+{ return (4*job->nblock); }
+
+char *Align_Job_Row(AlignJob *job, int64 row, char *buffer)
+{ Path   *path = job->aln.path;
+  AlnMark m;
+  int     u, v, o, r;
+  int     sa, sb, match, diff;
+  char   *t;
+
+  r = row % 4;
+  if (r == 0 || row < 0 || row >= 4*job->nblock)
+    { buffer[0] = '\0';
+      return (buffer);
+    }
+
+  m  = job->marks[row/4];
+  sa = m.i-1;
+  sb = m.j-1;
+  if (r == 1)
+    { if (sa < path->aepos)
+        t = buffer + sprintf(buffer," %*d ",ALIGN_COORD,sa);
+      else
+        t = buffer + sprintf(buffer," %*s ",ALIGN_COORD,"");
+    }
+  else if (r == 2)
+    t = buffer + sprintf(buffer," %*s ",ALIGN_COORD,"");
+  else
+    { if (sb < path->bepos)
+        { if (COMP(job->aln.flags))
+            t = buffer + sprintf(buffer," %*d ",ALIGN_COORD,job->aln.blen-sb);
+          else
+            t = buffer + sprintf(buffer," %*d ",ALIGN_COORD,sb);
+        }
+      else
+        t = buffer + sprintf(buffer," %*s ",ALIGN_COORD,"");
+    }
+
+  match = diff = 0;
+  for (o = 0; o < ALIGN_WIDTH && next_column(job,&m,&u,&v); o++)
+    { if (r == 1)
+        t[o] = N2A[u];
+      else if (r == 3)
+        t[o] = N2A[v];
+      else if (u == 4 || v == 4)
+        t[o] = ' ';
+      else if (u == v)
+        t[o] = '|';
+      else
+        t[o] = '*';
+      if (u == v)
+        match += 1;
+      else
+        diff += 1;
+    }
+  t += o;
+  *t = '\0';
+
+  if (r == 3 && diff+match > 0)
+    sprintf(t," %5.1f%%",(100.*diff)/(diff+match));
+  return (buffer);
+}
+
+
+/*******************************************************************************************
+*
+*   REGION EXPORT
+*
+*******************************************************************************************/
+
+#define EXPORT_BATCH 64   //  alignments per thread per batch
+
+typedef struct
+  { char  *s;
+    int64  len;
+    int64  max;
+  } Text;
+
+typedef struct
+  { RegionExport *ex;
+    Work_Data    *work;
+    uint8        *cols;     //  scratch for the columns of an alignment
+    int64         cmax;
+    volatile int *cancel;
+    int           fail;
+  } Exporter;
+
+struct _region_export
+  { DotPlot         *plot;
+    DotLayer        *layer;
+    int              format;
+    FILE            *out;
+    char            *path;
+    char            *temp;    //  written to in place of path, and renamed to it when complete
+    int64            nsegs;
+    DotSegment     **segs;    //  segments to export in .1aln order
+    int64            bnext;   //  next segment of the batch to compute
+    int64            bend;    //  end of the batch
+    AlignJob       **jobs;    //  jobs and output of the current batch
+    Text            *text;
+    pthread_mutex_t  mutex;   //  guards bnext
+  };
+
+static int ISORT(const void *l, const void *r)
+{ DotSegment *x = *((DotSegment **) l);
+  DotSegment *y = *((DotSegment **) r);
+
+  return (x->idx - y->idx);
+}
+
+RegionExport *New_Region_Export(DotPlot *plot, int ilay, Frame *region, char *path, int format)
+{ RegionExport *ex;
+  DotSegment   *segs, *line;
+  QuadLeaf     *list, *curn, *next;
+  int64         n;
+  int           i;
+
+  double xb = region->x;
+  double xe = region->x + region->w;
+  double yb = region->y;
+  double ye = region->y + region->h;
+
+  if (plot->db1->cache == NULL || plot->db2->cache == NULL)
+    { sprintf(EPLACE,"The genomes of the plot have no sequence\n");
+      return (NULL);
+    }
+
+  ex = (RegionExport *) Malloc(sizeof(RegionExport),"Allocating region export");
+  if (ex == NULL)
+    return (NULL);
+  ex->plot   = plot;
+  ex->layer  = plot->layers[ilay];
+  ex->format = format;
+  ex->jobs   = NULL;
+  ex->text   = NULL;
+  ex->path   = Strdup(path,"Allocating region export");
+  ex->temp   = Strdup(Catenate(path,"","",".tmp"),"Allocating region export");
+  if (ex->path == NULL || ex->temp == NULL)
+    { free(ex->temp);
+      free(ex->path);
+      free(ex);
+      return (NULL);
+    }
+
+  //  Collect the segments intersecting the region (the quad tree may return others nearby)
+
+  segs = ex->layer->segs;
+  list = Plot_Layer(plot,ilay,region);
+
+  n = 0;
+  for (curn = list; curn != NULL; curn = next)
+    { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
+      for ( ; curn->length > 0; curn++)
+        n += curn->length;
+    }
+
+  ex->segs = (DotSegment **) Malloc(sizeof(DotSegment *)*(n+1),"Allocating region export");
+  if (ex->segs == NULL)
+    { for (curn = list; curn != NULL; curn = next)
+        { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
+          for ( ; curn->length > 0; curn++)
+            for (i = 0; i < curn->length; i++)
+              segs[curn->idx[i]].mark = 0;
+        }
+      Free_List(list);
+      free(ex->temp);
+      free(ex->path);
+      free(ex);
+      return (NULL);
+    }
+
+  n = 0;
+  for (curn = list; curn != NULL; curn = next)
+    { next = (QuadLeaf *) (((QuadNode *) curn)[BLK_SIZE].quads[0]);
+      for ( ; curn->length > 0; curn++)
+        for (i = 0; i < curn->length; i++)
+          { line = segs + curn->idx[i];
+            line->mark = 0;
+            if (line->aend < xb || line->abeg > xe)
+              continue;
+            if (line->bbeg < line->bend)
+              { if (line->bend < yb || line->bbeg > ye)
+                  continue;
+              }
+            else
+              { if (line->bbeg < yb || line->bend > ye)
+                  continue;
+              }
+            ex->segs[n++] = line;
+          }
+    }
+  Free_List(list);
+
+  qsort(ex->segs,n,sizeof(DotSegment *),ISORT);
+  ex->nsegs = n;
+
+  ex->out = fopen(ex->temp,"w");
+  if (ex->out == NULL)
+    { sprintf(EPLACE,"Cannot open %s for writing\n",ex->temp);
+      free(ex->segs);
+      free(ex->temp);
+      free(ex->path);
+      free(ex);
+      return (NULL);
+    }
+
+  pthread_mutex_init(&(ex->mutex),NULL);
+  return (ex);
+}
+
+int64 Region_Export_Count(RegionExport *ex)
+{ return (ex->nsegs); }
+
+void Free_Region_Export(RegionExport *ex)
+{ if (ex == NULL)
+    return;
+  if (ex->out != NULL)              //  never run: remove the empty file
+    { fclose(ex->out);
+      unlink(ex->temp);
+    }
+  pthread_mutex_destroy(&(ex->mutex));
+  free(ex->segs);
+  free(ex->temp);
+  free(ex->path);
+  free(ex);
+}
+
+//  Make room for n more characters (and a terminating 0) in text t
+
+static int text_room(Text *t, int64 n)
+{ char *s;
+
+  if (t->len + n + 1 <= t->max)
+    return (0);
+  t->max = 1.2*(t->len+n+1) + 1000;
+  s = (char *) Realloc(t->s,t->max,"Allocating export text");
+  if (s == NULL)
+    return (1);
+  t->s = s;
+  return (0);
+}
+
+#define TEXT_ROOM(t,n)  if (text_room(t,n)) return (1);
+
+//  Append the rows of the alignment of job, headed by its title, to t
+
+static int text_record(AlignJob *job, Text *t)
+{ int64 r, rows;
+
+  TEXT_ROOM(t,strlen(job->title)+1)
+  t->len += sprintf(t->s+t->len,"%s\n",job->title);
+  rows = Align_Job_Rows(job);
+  for (r = 0; r < rows; r++)
+    { TEXT_ROOM(t,ALIGN_ROW_MAX+1)
+      Align_Job_Row(job,r,t->s+t->len);
+      t->len += strlen(t->s+t->len);
+      t->s[t->len++] = '\n';
+    }
+  TEXT_ROOM(t,1)
+  t->s[t->len++] = '\n';
+  return (0);
+}
+
+//  Append the PAF line of the alignment of job to t.  As PAF gives the alignment along the
+//    forward strand of the target (B), the columns of a complemented alignment are walked
+//    in reverse and complemented, i.e. as the reverse complement of A against B.
+
+static int paf_record(AlignJob *job, Exporter *w, Text *t)
+{ static char dna[8] = { 'a', 'c', 'g', 't', 'n', 'n', 'n', '-' };
+  static char cmp[8] = { 3, 2, 1, 0, 4, 4, 4, 7 };
+
+  GDB    *gdb1 = &(job->db1->gdb);
+  GDB    *gdb2 = &(job->db2->gdb);
+  Path   *path = job->aln.path;
+  uint8  *col;
+  AlnMark m;
+  int64   ncol, k, run, nmatch;
+  int     u, v, op, last;
+  char   *aname, *bname;
+
+  ncol = (path->aepos-path->abpos) + (path->bepos-path->bbpos);
+  if (2*ncol > w->cmax)
+    { w->cmax = 2.4*ncol + 1000;
+      col = (uint8 *) Realloc(w->cols,w->cmax,"Allocating export columns");
+      if (col == NULL)
+        return (1);
+      w->cols = col;
+    }
+  col = w->cols;
+
+  m = job->marks[0];
+  nmatch = 0;
+  for (k = 0; next_column(job,&m,&u,&v); k += 2)
+    { col[k]   = u;
+      col[k+1] = v;
+      if (u == v && u < 4)
+        nmatch += 1;
+    }
+  ncol = k/2;
+
+  if (COMP(job->aln.flags))
+    { uint8 x;
+
+      for (k = 0; k < ncol; k++)
+        { col[2*k]   = cmp[col[2*k]];
+          col[2*k+1] = cmp[col[2*k+1]];
+        }
+      for (k = 0; k < ncol/2; k++)
+        { x = col[2*k];
+          col[2*k] = col[2*(ncol-1-k)];
+          col[2*(ncol-1-k)] = x;
+          x = col[2*k+1];
+          col[2*k+1] = col[2*(ncol-1-k)+1];
+          col[2*(ncol-1-k)+1] = x;
         }
     }
 
-  alnptr = atext;
-  Transmit_Alignment(align_cat,aln,work,100,0,0,9,0);
+  aname = gdb1->headers + gdb1->scaffolds[job->ascaf].hoff;
+  bname = gdb2->headers + gdb2->scaffolds[job->bscaf].hoff;
+
+  TEXT_ROOM(t,strlen(aname)+strlen(bname)+200)
+  t->len += sprintf(t->s+t->len,"%.*s\t%lld\t%lld\t%lld\t%c\t%.*s\t%lld\t%lld\t%lld\t%lld\t%lld\t255",
+                    (int) strcspn(aname," \t"),aname,gdb1->scaffolds[job->ascaf].slen,
+                    job->abeg,job->aend,COMP(job->aln.flags)?'-':'+',
+                    (int) strcspn(bname," \t"),bname,gdb2->scaffolds[job->bscaf].slen,
+                    job->bbeg,job->bend,nmatch,ncol);
+  t->len += sprintf(t->s+t->len,"\tNM:i:%lld\tcg:Z:",ncol-nmatch);
+
+  //  CIGAR: I is a query (A) base opposite a gap in the target (B), D the reverse
+
+  last = 0;
+  run  = 0;
+  for (k = 0; k <= ncol; k++)
+    { if (k == ncol)
+        op = 0;
+      else if (col[2*k+1] == 7)
+        op = 'I';
+      else if (col[2*k] == 7)
+        op = 'D';
+      else
+        op = 'M';
+      if (op != last && run > 0)
+        { TEXT_ROOM(t,24)
+          t->len += sprintf(t->s+t->len,"%lld%c",run,last);
+          run = 0;
+        }
+      last = op;
+      run += 1;
+    }
+
+  TEXT_ROOM(t,6)
+  t->len += sprintf(t->s+t->len,"\tcs:Z:");
+
+  last = 0;
+  run  = 0;
+  for (k = 0; k <= ncol; k++)
+    { if (k == ncol)
+        op = 0;
+      else
+        { u = col[2*k];
+          v = col[2*k+1];
+          if (v == 7)
+            op = '+';
+          else if (u == 7)
+            op = '-';
+          else if (u == v && u < 4)
+            op = ':';
+          else
+            op = '*';
+        }
+      if (last == ':' && op != ':')
+        { TEXT_ROOM(t,24)
+          t->len += sprintf(t->s+t->len,":%lld",run);
+        }
+      TEXT_ROOM(t,3)
+      if (op == '*')
+        { t->s[t->len++] = '*';
+          t->s[t->len++] = dna[v];
+          t->s[t->len++] = dna[u];
+        }
+      else if (op == '+' || op == '-')
+        { if (op != last)
+            t->s[t->len++] = op;
+          t->s[t->len++] = dna[op == '+' ? u : v];
+        }
+      if (op != last)
+        run = 0;
+      last = op;
+      run += 1;
+    }
+
+  TEXT_ROOM(t,1)
+  t->s[t->len++] = '\n';
+  return (0);
+}
 
-  *title = atitle; 
-  return (atext);
+//  Compute and format the jobs of the current batch until there are none left
+
+static void *exporter(void *arg)
+{ Exporter     *w  = (Exporter *) arg;
+  RegionExport *ex = w->ex;
+  AlignJob     *job;
+  Text         *t;
+  int64         i;
+
+  while ( ! *(w->cancel))
+    { pthread_mutex_lock(&(ex->mutex));
+      i = ex->bnext++;
+      pthread_mutex_unlock(&(ex->mutex));
+      if (i >= ex->bend)
+        break;
+
+      job = ex->jobs[i];
+      t   = ex->text + i;
+      if (run_job(job,w->work,1,w->cancel))
+        { if ( ! *(w->cancel))
+            w->fail = 1;
+          break;
+        }
+      if (ex->format == EXPORT_PAF)
+        w->fail = paf_record(job,w,t);
+      else
+        w->fail = text_record(job,t);
+      Free_Align_Job(job);
+      ex->jobs[i] = NULL;
+      if (w->fail)
+        break;
+    }
+  return (NULL);
+}
+
+int Run_Region_Export(RegionExport *ex, int nthreads, volatile int *cancel, volatile int64 *done)
+{ Exporter  *work;
+  pthread_t *threads;
+  int64      bsize, b, i, n;
+  int        t, fail;
+
+  if (nthreads < 1)
+    nthreads = 1;
+  bsize = EXPORT_BATCH*nthreads;
+
+  fail    = 1;
+  work    = (Exporter *) Malloc(sizeof(Exporter)*nthreads,"Allocating export threads");
+  threads = (pthread_t *) Malloc(sizeof(pthread_t)*nthreads,"Allocating export threads");
+  ex->jobs = (AlignJob **) Malloc(sizeof(AlignJob *)*bsize,"Allocating export batch");
+  ex->text = (Text *) Malloc(sizeof(Text)*bsize,"Allocating export batch");
+  if (work == NULL || threads == NULL || ex->jobs == NULL || ex->text == NULL)
+    goto exit0;
+  for (i = 0; i < bsize; i++)
+    { ex->jobs[i] = NULL;
+      ex->text[i].s   = NULL;
+      ex->text[i].max = 0;
+    }
+
+  for (t = 0; t < nthreads; t++)
+    { work[t].ex     = ex;
+      work[t].cols   = NULL;
+      work[t].cmax   = 0;
+      work[t].cancel = cancel;
+      work[t].work   = New_Work_Data();
+      if (work[t].work == NULL)
+        { nthreads = t;
+          goto exit1;
+        }
+    }
+
+  *done = 0;
+  for (b = 0; b < ex->nsegs; b += bsize)
+    { n = ex->nsegs - b;
+      if (n > bsize)
+        n = bsize;
+
+      for (i = 0; i < n; i++)
+        { ex->jobs[i] = new_job(ex->plot,ex->layer,ex->segs[b+i]);
+          if (ex->jobs[i] == NULL)
+            goto exit2;
+          ex->text[i].len = 0;
+        }
+      ex->bnext = 0;
+      ex->bend  = n;
+
+      for (t = 0; t < nthreads; t++)
+        { work[t].fail = 0;
+          if (pthread_create(threads+t,NULL,exporter,work+t) != 0)
+            { sprintf(EPLACE,"Could not start export threads\n");
+              *cancel = 1;
+              break;
+            }
+        }
+      while (t-- > 0)
+        pthread_join(threads[t],NULL);
+
+      for (t = 0; t < nthreads; t++)
+        if (work[t].fail)
+          goto exit2;
+      if (*cancel)
+        goto exit2;
+
+      for (i = 0; i < n; i++)
+        if (fwrite(ex->text[i].s,1,ex->text[i].len,ex->out) != (size_t) ex->text[i].len)
+          { sprintf(EPLACE,"Could not write to %s\n",ex->path);
+            goto exit2;
+          }
+      *done = b+n;
+    }
+
+  if (fclose(ex->out) != 0)
+    sprintf(EPLACE,"Could not write to %s\n",ex->path);
+  else if (rename(ex->temp,ex->path) != 0)
+    sprintf(EPLACE,"Could not rename %s to %s\n",ex->temp,ex->path);
+  else
+    fail = 0;
+  ex->out = NULL;
+
+exit2:
+  for (i = 0; i < bsize; i++)
+    { Free_Align_Job(ex->jobs[i]);
+      ex->jobs[i] = NULL;
+    }
+exit1:
+  for (t = 0; t < nthreads; t++)
+    { free(work[t].cols);
+      Free_Work_Data(work[t].work);
+    }
+  for (i = 0; i < bsize; i++)
+    free(ex->text[i].s);
+exit0:
+  free(ex->text);
+  free(ex->jobs);
+  ex->text = NULL;
+  ex->jobs = NULL;
+  free(threads);
+  free(work);
+
+  //  A cancelled or failed export leaves no partial file behind
+
+  if (fail)
+    { if (ex->out != NULL)
+        { fclose(ex->out);
+          ex->out = NULL;
+        }
+      unlink(ex->temp);
+    }
+  return (fail);
+}
+
+
+/*******************************************************************************************
+*
+*   LOCAL IDENTITY
+*
+*******************************************************************************************/
+
+//  The trace cache of a layer is a hash table of TRACE_BUCKETS chains keyed by segment index,
+//    whose size is counted against TRACE_CACHE_MEMORY, and an LRU list of the entries present.
+//    An entry holds the (diffs, b-length) pairs of the trace as read and the a-length of its
+//    first interval, all others but the last spanning tspace.
+
+#define TRACE_BUCKETS (TRACE_CACHE_MEMORY/256)   //  a power of 2, 512KB of chain heads
+
+typedef struct _trace_entry
+  { struct _trace_entry *newer;
+    struct _trace_entry *older;
+    struct _trace_entry *next;    //  next entry of its hash chain
+    int64  seg;       //  index of the segment in the layer
+    int    tlen;      //  # of trace values
+    int    afirst;    //  a-length of the first interval
+    uint8 *trace;
+  } TraceEntry;
+
+struct _trace_cache
+  { TraceEntry **bucket;    //  bucket[s & (TRACE_BUCKETS-1)] = chain of entries with key s
+    TraceEntry  *newest;
+    TraceEntry  *oldest;
+    int64        bytes;
+    uint8       *tbuf;      //  buffer for reading a trace
+    int          pmax;      //  # of intervals there is room for in poly
+    SegTrace     poly;      //  result of the last Segment_Trace
+  };
+
+static struct _trace_cache *new_trace_cache(DotLayer *layer)
+{ struct _trace_cache *tc;
+  int64 s;
+
+  tc = (struct _trace_cache *) Malloc(sizeof(struct _trace_cache),"Allocating trace cache");
+  if (tc == NULL)
+    return (NULL);
+  tc->bucket = (TraceEntry **) Malloc(sizeof(TraceEntry *)*TRACE_BUCKETS,
+                                      "Allocating trace cache");
+  tc->tbuf   = (uint8 *) Malloc(2*(layer->input->info['T']->given.max+1),
+                                "Allocating trace cache");
+  if (tc->bucket == NULL || tc->tbuf == NULL)
+    { free(tc->tbuf);
+      free(tc->bucket);
+      free(tc);
+      return (NULL);
+    }
+  for (s = 0; s < TRACE_BUCKETS; s++)
+    tc->bucket[s] = NULL;
+  tc->newest = NULL;
+  tc->oldest = NULL;
+  tc->bytes  = sizeof(TraceEntry *)*TRACE_BUCKETS;
+  tc->pmax   = 0;
+  tc->poly.apos  = NULL;
+  tc->poly.bpos  = NULL;
+  tc->poly.diffs = NULL;
+  return (tc);
+}
+
+static void trace_unlink(struct _trace_cache *tc, TraceEntry *e)
+{ if (e->newer == NULL)
+    tc->newest = e->older;
+  else
+    e->newer->older = e->older;
+  if (e->older == NULL)
+    tc->oldest = e->newer;
+  else
+    e->older->newer = e->newer;
+}
+
+static void trace_push(struct _trace_cache *tc, TraceEntry *e)
+{ e->older = tc->newest;
+  e->newer = NULL;
+  if (tc->newest == NULL)
+    tc->oldest = e;
+  else
+    tc->newest->newer = e;
+  tc->newest = e;
+}
+
+//  Read the trace of seg into a new entry
+
+static TraceEntry *read_trace(DotLayer *layer, DotSegment *seg)
+{ struct _trace_cache *tc = layer->traces;
+  OneFile    *in = layer->input;
+  Overlap     ovl;
+  TraceEntry *e;
+  int         tlen, ab;
+
+  pthread_mutex_lock(&(layer->lock));
+  if ( ! oneGoto(in,'A',seg->idx+1))
+    { pthread_mutex_unlock(&(layer->lock));
+      sprintf(EPLACE,"Could not find alignment %d in %s\n",seg->idx+1,layer->name);
+      return (NULL);
+    }
+  oneReadLine(in);
+  Read_Aln_Overlap(in,&ovl);
+  tlen = Read_Aln_Trace(in,tc->tbuf);
+  pthread_mutex_unlock(&(layer->lock));
+
+  e = (TraceEntry *) Malloc(sizeof(TraceEntry)+tlen,"Allocating trace points");
+  if (e == NULL)
+    return (NULL);
+  e->trace = (uint8 *) (e+1);
+  memcpy(e->trace,tc->tbuf,tlen);
+  ab = ovl.path.abpos;
+  e->seg    = seg - layer->segs;
+  e->tlen   = tlen;
+  e->afirst = (ab/layer->tspace+1)*layer->tspace - ab;
+  return (e);
+}
+
+SegTrace *Segment_Trace(DotLayer *layer, DotSegment *seg, int *reads)
+{ struct _trace_cache *tc;
+  TraceEntry *e, *o, **c;
+  SegTrace   *p;
+  int64       s, a, b;
+  int         i, n, dir;
+
+  tc = layer->traces;
+  if (tc == NULL)
+    { tc = new_trace_cache(layer);
+      if (tc == NULL)
+        return (NULL);
+      layer->traces = tc;
+    }
+
+  s = seg - layer->segs;
+  for (e = tc->bucket[s & (TRACE_BUCKETS-1)]; e != NULL; e = e->next)
+    if (e->seg == s)
+      break;
+  if (e != NULL)
+    trace_unlink(tc,e);
+  else
+    { if (reads != NULL)
+        { if (*reads <= 0)
+            { *reads = -1;
+              return (NULL);
+            }
+          *reads -= 1;
+        }
+      e = read_trace(layer,seg);
+      if (e == NULL)
+        return (NULL);
+      e->next = tc->bucket[s & (TRACE_BUCKETS-1)];
+      tc->bucket[s & (TRACE_BUCKETS-1)] = e;
+      tc->bytes += sizeof(TraceEntry) + e->tlen;
+      while (tc->bytes > TRACE_CACHE_MEMORY && (o = tc->oldest) != NULL)
+        { trace_unlink(tc,o);
+          for (c = tc->bucket + (o->seg & (TRACE_BUCKETS-1)); *c != o; c = &((*c)->next))
+            continue;
+          *c = o->next;
+          tc->bytes -= sizeof(TraceEntry) + o->tlen;
+          free(o);
+        }
+    }
+  trace_push(tc,e);
+
+  p = &(tc->poly);
+  n = e->tlen/2;
+  if (p->apos == NULL || n > tc->pmax)
+    { int64 *apos, *bpos;
+      int   *diffs;
+
+      apos  = (int64 *) Realloc(p->apos,sizeof(int64)*(n+1),"Allocating trace points");
+      if (apos == NULL)
+        return (NULL);
+      p->apos = apos;
+      bpos  = (int64 *) Realloc(p->bpos,sizeof(int64)*(n+1),"Allocating trace points");
+      if (bpos == NULL)
+        return (NULL);
+      p->bpos = bpos;
+      diffs = (int *) Realloc(p->diffs,sizeof(int)*(n+1),"Allocating trace points");
+      if (diffs == NULL)
+        return (NULL);
+      p->diffs = diffs;
+      tc->pmax = n;
+    }
+
+  //  The a-coordinate advances to the next multiple of tspace, the b-coordinate by the
+  //    b-length of the interval, downwards if the segment is on the complement strand
+
+  dir = (seg->bbeg <= seg->bend) ? 1 : -1;
+  a   = seg->abeg;
+  b   = seg->bbeg;
+  p->npts    = n;
+  p->apos[0] = a;
+  p->bpos[0] = b;
+  for (i = 0; i < n; i++)
+    { a += (i == 0) ? e->afirst : layer->tspace;
+      if (a > seg->aend || i == n-1)
+        a = seg->aend;
+      b += dir * e->trace[2*i+1];
+      p->diffs[i]  = e->trace[2*i];
+      p->apos[i+1] = a;
+      p->bpos[i+1] = b;
+    }
+
+  return (p);
+}
+
+static void Free_Trace_Cache(DotLayer *layer)
+{ struct _trace_cache *tc = layer->traces;
+  TraceEntry *e, *o;
+
+  if (tc == NULL)
+    return;
+  for (e = tc->newest; e != NULL; e = o)
+    { o = e->older;
+      free(e);
+    }
+  free(tc->poly.diffs);
+  free(tc->poly.bpos);
+  free(tc->poly.apos);
+  free(tc->tbuf);
+  free(tc->bucket);
+  free(tc);
+  layer->traces = NULL;
 }
@@ -1,9 +1,14 @@
 #ifndef STICKS
 #define STICKS
 
+#include <pthread.h>
+
 #include "gene_core.h"
 #include "GDB.h"
 #include "hash.h"
+#include "dotindex.h"
+#include "seqcache.h"
+#include "coordindex.h"
 #include "ONElib.h"
 
 
@@ -37,23 +42,38 @@ int64 divide_bar(int64 t);
 
 int64 digits(int64 t, char **suf, int *prec);
 
-char *Map_Coord(GDB *gdb, int64 coord, int64 coord2, int format, int64 width);
-
 
   //  Data structures and routines for Quad Trees
+  //
+  //  Every interior node of a layer's quad tree has the sums of the segment pieces below it
+  //    (each segment clipped to the node's frame) from which the aggregate statistics of a
+  //    region are had without visiting the segments of the nodes wholly inside it.
+
+#define BLK_SIZE 100000   //  Quad tree blocks ~4.8MB
 
-#define BLK_SIZE 100000   //  Quad tree blocks ~4.6MB
+#define ID_LOW  70              //  % identities below this share the lowest histogram bin
+#define ID_BINS (100-ID_LOW+2)
+
+typedef struct
+  { int64  nsegs;           //  # of segments that start in the node
+    double abp;             //  a-length of the segment pieces in the node
+    double fbp;             //  a-length of those on the forward strand
+    double ibp;             //  sum of a-length x % identity of the pieces
+    float  hist[ID_BINS];   //  a-length of the pieces of each % identity (< ID_LOW, ID_LOW..100)
+  } QuadSum;
 
 typedef struct
-  { int   length;
-    int   depth;
-    int   idx[8];
+  { int      length;
+    int      depth;
+    int      idx[8];
+    QuadSum *sum;     //  unused, a leaf is the size of a node
   } QuadLeaf;
 
 typedef struct _qnode
   { int            length;
     int            depth;
     struct _qnode *quads[4];
+    QuadSum       *sum;       //  sums of an interior node
   } QuadNode;
 
 
@@ -73,20 +93,29 @@ typedef struct
   { int         nref;
     char       *name;
     OneFile    *input;
+    pthread_mutex_t lock;   //  serializes reads from input
+    struct _trace_cache *traces;   //  trace points read for local identity, NULL until needed
     int64       novls;
     int         tspace;
     DotSegment *segs;
     QuadNode   *qtree;
     QuadNode   *blocks;
+    QuadSum    *sums;     //  sums of the interior nodes of qtree
   } DotLayer;
 
 typedef struct
-  { int        nref;
-    GDB        gdb;
-    char      *hash;
-    char      *name;
+  { int              nref;
+    GDB              gdb;
+    char            *hash;
+    char            *name;
+    pthread_mutex_t  lock;    //  serializes sequence reads from gdb if it is not memory mapped
+    DotIndex        *index;   //  mapped minimizer index for the dot plot, NULL if none
+    SeqCache        *cache;   //  decoded sequence for alignments, NULL if gdb has no sequence
+    CoordIndex      *coords;  //  scaffold & contig containing a global coordinate
   } DotGDB;
 
+#define SEQ_CACHE_MEMORY 0x4000000   //  Memory cap of each GDB's sequence cache (64MB)
+
 typedef struct
   { int64        alen;
     int64        blen;
@@ -94,8 +123,6 @@ typedef struct
     DotGDB      *db2;
     int          nlays;
     DotLayer    *layers[MAX_LAYERS];
-    int          dotref;
-    void        *dotmemory;
   } DotPlot;
 
 DotPlot *createPlot(char *alnPath, int lCut, int iCut, int sCut, DotPlot *plot);
@@ -106,11 +133,125 @@ QuadLeaf *Plot_Layer(DotPlot *plot, int ilay, Frame *query);
 
 void Free_List(QuadLeaf *list);
 
+  //  Aggregate statistics of the segments of layer ilay in region, each clipped to it
+
+typedef struct
+  { int64  nsegs;    //  # of alignments that start in the region
+    double abp;      //  aligned a-bp in the region
+    double fbp;      //  aligned a-bp of those on the forward strand
+    double mean;     //  mean % identity weighted by aligned bp
+    int    median;   //  median % identity weighted by aligned bp (ID_LOW-1 if below ID_LOW)
+  } RegionStats;
+
+void Region_Stats(DotPlot *plot, int ilay, Frame *region, RegionStats *stats);
+
 void Free_DotPlot(DotPlot *plot);
 
+  //  Display string of global coordinate coord (and/or coord2 if >= 0) of genome db in format
+
+char *Map_Coord(DotGDB *db, int64 coord, int64 coord2, int format, int64 width);
+
+  //  Build (or rebuild) the dot plot minimizer index of each genome of plot with nthreads
+  //    threads and map it.  No dot plot may be in progress on the plot.  *done is set to the
+  //    # of bases indexed so far (of the seqtot of each distinct genome), and the build stops
+  //    if *cancel becomes non-zero.  Returns non-zero with a message in EPLACE on failure
+  //    or cancellation.
+
+int Index_DotPlot(DotPlot *plot, int nthreads, volatile int *cancel, volatile int64 *done);
+
 
   //  Data structures and routines to support alignment generation & display
+  //
+  //  New_Align_Job reads the alignment of segment seg of layer from its .1aln file into a
+  //    new job, which is quick and may be done by any thread (reads of a layer's file are
+  //    serialized by its lock).  Run_Align_Job then computes the exact alignment, which can
+  //    take a long time and may be done in another thread, each concurrent job having its
+  //    own working storage.  A long alignment is split at its trace points into pieces that
+  //    are computed by up to nthreads threads.  It gives up as soon as it sees *cancel
+  //    non-zero.  Both return NULL or non-zero with a message in EPLACE on failure.
+  //
+  //  A computed alignment is displayed as Align_Job_Rows rows of text, formatted one at a
+  //    time on demand by Align_Job_Row into a buffer of ALIGN_ROW_MAX bytes.  Every 4th row
+  //    (from the 0th) is blank, the other three show the a-sequence, the matches, and the
+  //    b-sequence of the next 100 columns.
+  //
+  //  Computed alignments are kept in a cache shared by all plots, so that New_Align_Job of
+  //    an alignment seen recently returns its computed job, for which Run_Align_Job does
+  //    nothing.  A job may so be held by several callers and is freed by the last of them
+  //    to call Free_Align_Job (or by the cache when it is evicted).
+
+#define ALIGN_ROW_MAX      128
+#define ALIGN_CACHE_MEMORY 0x4000000   //  Memory cap of the computed alignment cache (64MB)
+
+typedef struct _align_job AlignJob;
+
+AlignJob *New_Align_Job(DotPlot *plot, DotLayer *layer, DotSegment *seg);
+
+int Run_Align_Job(AlignJob *job, int nthreads, volatile int *cancel);
+
+char *Align_Job_Title(AlignJob *job);   //  "<scaffold>.<contig>[beg..end] x ..." of the job
+
+int64 Align_Job_Rows(AlignJob *job);
+
+char *Align_Job_Row(AlignJob *job, int64 row, char *buffer);
+
+void Free_Align_Job(AlignJob *job);
+
+  //  Statistics of the computed alignment cache: lookups that hit and missed, bytes held
+
+void Align_Cache_Stats(int64 *hits, int64 *misses, int64 *bytes);
+
+  //  A region export writes the exact alignment of every segment of layer ilay that
+  //    intersects region to a file, in the order of the segments in the layer's .1aln file,
+  //    either as the text shown by an alignment window or as PAF records (A the query and
+  //    B the target) with cg:Z: CIGAR and cs:Z: difference string tags.
+  //
+  //  New_Region_Export finds the segments and opens the file, and must be done by the
+  //    thread that owns the plot's quad trees.  Run_Region_Export computes the alignments
+  //    with nthreads threads, each with its own working storage, in batches that are then
+  //    written out in order, setting *done to the number written so far.  It gives up as
+  //    soon as it sees *cancel non-zero.  The file is written under path with .tmp appended
+  //    and renamed to path only once complete, so a cancelled or failed export leaves none.
+  //    Both return NULL or non-zero with a message in EPLACE on failure.
+
+#define EXPORT_TEXT 0
+#define EXPORT_PAF  1
+
+typedef struct _region_export RegionExport;
+
+RegionExport *New_Region_Export(DotPlot *plot, int ilay, Frame *region, char *path, int format);
+
+int64 Region_Export_Count(RegionExport *ex);    //  # of alignments to be exported
+
+int Run_Region_Export(RegionExport *ex, int nthreads, volatile int *cancel, volatile int64 *done);
+
+void Free_Region_Export(RegionExport *ex);
+
+  //  The local identity of an alignment is read off the trace points of its .1aln record,
+  //    whose X list gives the # of differences in each trace point interval, without any
+  //    alignment being computed.  Segment_Trace returns the trace points of segment seg of
+  //    layer in global coordinates and the # of differences between each consecutive pair.
+  //    The trace points of segments are read on first demand and kept in an LRU cache of
+  //    each layer capped at TRACE_CACHE_MEMORY bytes, its hash table included, so that its
+  //    size does not grow with the number of alignments.  The result is valid until the next
+  //    call, and must be asked for by the thread that owns the plot's quad trees.  Returns
+  //    NULL with a message in EPLACE on failure.  If reads is not NULL a trace not in the
+  //    cache is read only if *reads > 0, which is then decremented, and otherwise NULL is
+  //    returned with *reads set to -1, so that a caller can bound the file reads it waits on.
+
+#define TRACE_CACHE_MEMORY 0x1000000   //  Memory cap of each layer's trace point cache (16MB)
+
+typedef struct
+  { int    npts;    //  # of trace point intervals
+    int64 *apos;    //  apos[0..npts], bpos[0..npts]: the trace points in global coordinates
+    int64 *bpos;
+    int   *diffs;   //  diffs[i]: # of differences between trace points i and i+1
+  } SegTrace;
+
+SegTrace *Segment_Trace(DotLayer *layer, DotSegment *seg, int *reads);
+
+  //  Accumulate the sequence cache statistics of the genomes of plot
 
-char *create_alignment(DotPlot *plot, DotLayer *layer, DotSegment *seg, char **title);
+void Cache_Stats(DotPlot *plot, int64 *hits, int64 *misses, int64 *bytes);
 
 #endif